@@ -0,0 +1,35 @@
+// bench.h
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <cstddef>
+#include <string>
+
+/*
+===============================================================================
+
+    7th Guest - Benchmarks
+
+    Times the codec and render hot paths over every VDX file of an RL/GJD
+    pair: LZSS in both directions, 0x20 and 0x25 decoding (RGB and
+    palette-indexed), whole-file parseVDXChunks, and frame upload/present
+    with each renderer.
+
+    Every call is one sample. Each benchmark reports MB/s, frames/s and
+    p50/p99 latency on the console and in a JSON report, so runs can be
+    compared between releases.
+
+===============================================================================
+*/
+
+struct BenchOptions
+{
+    bool render = true;                 // Also time frame upload and present with each renderer
+    size_t renderFrames = 600;          // Frames presented per renderer
+    std::string output;                 // JSON report; <RL name>_bench.json when empty
+};
+
+int runBenchmarks(const std::string& rlFilename, const BenchOptions& options = {});
+
+#endif // BENCH_H
\ No newline at end of file
@@ -4,9 +4,13 @@
 #define BITMAP_H
 
 #include <vector>
+#include <array>
+#include <bitset>
 #include <tuple>
 #include <cstdint>
 #include <string>
+#include <span>
+#include <unordered_map>
 
 /*
 ===============================================================================
@@ -18,6 +22,8 @@
 ===============================================================================
 */
 
+class ThreadPool;
+
 struct RGBColor
 {
     uint8_t r, g, b;
@@ -27,6 +33,68 @@ struct RGBColor
     }
 };
 
+// 8-bit palette-indexed frame, the native 7th Guest representation
+struct IndexedFrame
+{
+    int width = 0;
+    int height = 0;
+    std::array<RGBColor, 256> palette{};
+    std::vector<uint8_t> pixels;        // width * height palette indices
+    std::vector<uint8_t> tiles;         // Undecoded 0x20 tile stream; while non-empty, pixels are stale
+
+    void resize(int newWidth, int newHeight);
+};
+
+// Pixel rectangle within a frame
+struct PixelRect
+{
+    int x, y, width, height;
+};
+
+// 4x4 tiles changed by the last decoded frame of a 640x320 clip
+struct DirtyTiles
+{
+    static constexpr int columns = 640 / 4;
+    static constexpr int rows = 320 / 4;
+
+    std::bitset<columns * rows> tiles;
+    bool palette = false;               // Palette entries changed; every pixel may look different
+
+    void mark(int tileX, int tileY)
+    {
+        if (tileX >= 0 && tileX < columns && tileY >= 0 && tileY < rows)
+            tiles.set(tileY * columns + tileX);
+    }
+    bool test(int tileX, int tileY) const { return tiles.test(tileY * columns + tileX); }
+    void markAll() { tiles.set(); palette = true; }
+    void clear() { tiles.reset(); palette = false; }
+    bool empty() const { return !palette && tiles.none(); }
+    void merge(const DirtyTiles& other) { tiles |= other.tiles; palette = palette || other.palette; }
+    std::vector<PixelRect> rects(size_t maxRects = 32) const;
+};
+
+// Colour -> palette index. Exact colours go through a hash; anything else
+// through an 18-bit RGB cube whose cells are filled with the nearest
+// palette entry on first use. The palette must outlive the matcher.
+class PaletteMatcher
+{
+public:
+    explicit PaletteMatcher(std::span<const RGBColor> palette);
+
+    uint8_t match(const RGBColor& color);
+    const RGBColor& operator[](uint8_t index) const { return palette[index]; }
+
+private:
+    static constexpr uint16_t NoMatch = 0xFFFF;
+
+    static uint32_t key(const RGBColor& color) { return (uint32_t(color.r) << 16) | (uint32_t(color.g) << 8) | color.b; }
+    uint16_t nearest(const RGBColor& color) const;
+
+    std::span<const RGBColor> palette;
+    std::unordered_map<uint32_t, uint8_t> exact;
+    std::vector<uint16_t> cube;
+};
+
 template <typename T>
 T readLittleEndian(const uint8_t* data)
 {
@@ -38,7 +106,13 @@ T readLittleEndian(const uint8_t* data)
     return result;
 }
 
-std::tuple<std::vector<RGBColor>, std::vector<uint8_t>> getBitmapData(const std::vector<uint8_t>& chunkData);
+std::tuple<std::vector<RGBColor>, std::vector<uint8_t>> getBitmapData(std::span<const uint8_t> chunkData);
+void getBitmapIndices(std::span<const uint8_t> chunkData, IndexedFrame& frame);
+void getBitmapIndices(std::span<const uint8_t> chunkData, IndexedFrame& frame, ThreadPool& pool);
+void getBitmapTiles(std::span<const uint8_t> chunkData, IndexedFrame& frame);
+void expandBitmapTiles(IndexedFrame& frame);
+std::vector<uint8_t> expandToRGB(const IndexedFrame& frame);
+std::array<uint8_t, 4> fitTile(const std::array<RGBColor, 16>& pixels, PaletteMatcher& matcher);
 std::vector<uint8_t> packBitmapData(const std::vector<uint8_t>& rawImageData, const std::vector<RGBColor>& palette, int width, int height);
 
 #endif // BITMAP_H
\ No newline at end of file
@@ -0,0 +1,73 @@
+// cache.h
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <cstdint>
+#include <list>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <utility>
+
+#include "playback.h"
+#include "views.h"
+
+enum class Room;
+
+/*
+===============================================================================
+
+    7th Guest - Clip Cache
+
+    Decoded clips shared by every room, keyed by (room, view). Each entry is
+    a WarmClip, so a cache hit starts playback without decoding anything.
+    Entries are evicted in LRU order once the byte budget is exceeded.
+
+    The prefetcher fills the cache from its worker thread and loadView()
+    reads from it, so every member function locks.
+
+===============================================================================
+*/
+
+class ClipCache
+{
+public:
+    using Key = std::pair<Room, ViewId>;
+
+    struct Stats
+    {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        size_t clips = 0;
+        size_t bytes = 0;
+        size_t budget = 0;
+    };
+
+    void setBudget(size_t bytes);
+    std::optional<WarmClip> find(const Key& key);
+    bool touch(const Key& key);
+    void insert(Key key, WarmClip clip);
+    Stats stats() const;
+
+private:
+    struct Entry
+    {
+        Key key;
+        WarmClip clip;
+        size_t bytes = 0;
+    };
+
+    void evict();
+
+    mutable std::mutex mutex;
+    std::list<Entry> lru;                                       // Most recently used first
+    std::map<Key, std::list<Entry>::iterator> index;
+    size_t bytes = 0;
+    size_t budget = 256ull * 1024 * 1024;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+};
+
+#endif // CACHE_H
\ No newline at end of file
@@ -26,7 +26,11 @@ constexpr const char* default_config = R"({
     "pcmVolume": 100,
     "midiEnabled": true,
     "midiVolume": 100,
-    "devMode": false
+    "music": {},
+    "devMode": false,
+    "traceFile": "",
+    "cacheBudgetMB": 256,
+    "gpuTileDecode": true
 })";
 
 //=============================================================================
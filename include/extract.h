@@ -5,8 +5,7 @@
 
 #include <string>
 
-#include <png.h>
-
+#include "pngwriter.h"
 #include "xmi.h"
 
 /*
@@ -14,7 +13,8 @@
 
     7th Guest - Command-line extraction functions
 
-    Extracts *.VDX , *.XMI, and *.PNG/*.RAW files from *.GJD files
+    Extracts *.VDX , *.XMI, and *.PNG/*.RAW files from *.GJD files, and
+    encodes *.VDX clips to video
 
 ===============================================================================
 */
@@ -22,8 +22,9 @@
 void GJDInfo(const std::string_view& filename);
 void extractXMI(const std::vector<uint8_t>& midiData, std::string name);
 void extractVDX(const std::string_view& filename);
-void extractPNG(const std::string_view& filename, bool raw);
+void extractPNG(const std::string_view& filename, bool raw, const PNGOptions& pngOptions = {});
+void extractPNGBatch(const std::string_view& path, bool raw, const PNGOptions& pngOptions = {});
 void savePNG(const std::string& filename, const std::vector<uint8_t>& imageData, int width, int height);
-void createVideoFromImages(const std::string& filenameParam);
+void exportVideo(const std::string_view& filename, int scale = 2, int fps = 15);
 
 #endif // EXTRACT_H
\ No newline at end of file
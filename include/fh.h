@@ -3,8 +3,6 @@
 #ifndef FH_H
 #define FH_H
 
-#include <unordered_map>
-
 #include "game.h"
 
 /*
@@ -219,261 +217,202 @@ h_prmorp
 f_ prefix for Foyer views
 
 */
-const std::unordered_map<std::string, View> f_ = {
-	////////////////////////////////////////////////////////////////////////
-	// f_1
-	////////////////////////////////////////////////////////////////////////
-
-	//
-	// Turning left towards front door
-	//
-	{
-		"f_1ba",
-		{
-			{	// Hotspots
-				{0.0f, 0.0f, 0.0f, 0.0f, []() { /* Intro Movie */ }},
-				{0.0f, 0.0f, 0.0f, 0.0f, []() { /* Spider Puzzle */ }}
-			},
-			{	// Navigation
-				{"f_1bd", {0.0f, 0.0f, 25.0f, 100.0f}},			// Left
-				{"x", {100.0f, 0.0f, 25.0f, 100.0f}}			// Right
-			}
-		}
-	},
-	//
-	// Stairs, turning left
-	//
-	{
-		"f_1bb",
-		{
-			{},
-			{   // Navigation
-				{"f_1ba", {0.0f, 0.0f, 10.0f, 100.0f}},			// Left
-				{"x", {0.0f, 0.0f, 0.0f, 0.0f}},				// Dining Room
-				{"f_1fb", {90.0f, 0.0f, 10.0f, 100.0f}}			// Right
-			}
-		}
-	},
-	//
-	// turning left towards Stairs *first view
-	//
-	{
-		"f_1bc",
-		{
-			{},
-			{   // Navigation
-				{"f_1bb", {0.0f, 0.0f, 10.0f, 100.0f}},			// Left
-				{"x", {33.0f, 0.0f, 33.0f, 85.0f}},				// Forward
-				{"f_1fc", {90.0f, 0.0f, 10.0f, 100.0f}},		// Right
-				{"x", {0.0f, 50.0f, 17.0f, 30.0f}},				// Dining Room
-				{"x", {80.0f, 50.0f, 20.0f, 30.0f}}				// Music Room
-			}
-		}
-	},
-	//
-	// front door, turning left
-	//
-	{
-		"f_1bd",
-		{
-			{},
-			{   // Navigation
-				{"x", {0.0f, 0.0f, 10.0f, 100.0f}},			// Left
-				{"x", {0.0f, 70.0f, 25.0f, 30.0f}},				// Music Room
-				{"x", {33.0f, 33.0f, 5.0f, 30.0f}},				// Library
-				{"x", {90.0f, 0.0f, 10.0f, 100.0f} }			// Right
-			}
-		}
-	},
-	//
-	// front door, turning right
-	//
-	{
-		"f_1fa",
-		{
-			{},
-			{   // Navigation
-				{"f_1ba", {0.0f, 0.0f, 25.0f, 100.0f}},			// Left
-				{"f_1fb", {100.0f, 0.0f, 25.0f, 100.0f}},		// Right
-				{"x", {33.0f, 33.0f, 5.0f, 30.0f}}				// Library
-			}
-		}
-	},
-	//
-	// turning right towards stairs
-	//
-	{
-		"f_1fb",
-		{
-			{},
-			{   // Navigation
-				{"f_1bb", {0.0f, 0.0f, 10.0f, 100.0f}},			// Left
-				{"x", {33.0f, 0.0f, 33.0f, 85.0f}},				// Forward
-				{"f_1fc", {90.0f, 0.0f, 10.0f, 100.0f}},		// Right
-				{"x", {0.0f, 50.0f, 17.0f, 30.0f}},				// Dining Room
-				{"x", {80.0f, 50.0f, 20.0f, 30.0f}}				// Music Room
-			}
-		}
-	},
-	//
-	// Stairs, turning right
-	//
-	{
-		"f_1fc",
-		{
-			{},
-			{   // Navigation
-				{"f_1bc", {0.0f, 0.0f, 10.0f, 100.0f}},			// Left
-				{"f_1fd", {90.0f, 0.0f, 10.0f, 100.0f}},		// Right
-				{"x", {33.0f, 33.0f, 5.0f, 30.0f}}				// Library
-			}
-		}
-	},
-	//
-	// turning right towards front door
-	//
-	{
-		"f_1fd",
-		{
-			{	// Hotspots
-				{0.0f, 0.0f, 0.0f, 0.0f, []() { /* Intro Movie */ }},
-				{0.0f, 0.0f, 0.0f, 0.0f, []() { /* Spider Puzzle */ }}
-			},
-			{	// Navigation
-				{"f_1bd", {0.0f, 0.0f, 25.0f, 100.0f}},			// Left
-				{"x", {100.0f, 0.0f, 25.0f, 100.0f}}			// Right
-			}
-		}
-	},
-
-	////////////////////////////////////////////////////////////////////////
-	// f_2
-	////////////////////////////////////////////////////////////////////////
-
-	//
-	// Dining Room, turning left
-	//
-	{
-		"f_2ba",
-		{
-			{},
-			{
-				{"x", {0.0f, 0.0f, 25.0f, 100.0f}},			// Left
-				{"x", {33.0f, 0.0f, 33.0f, 100.0f}},		// Forward
-				{"x", {100.0f, 0.0f, 25.0f, 100.0f}},		// Right
-			}
-		}
-	},
-	//
-	// Kitchen, turning left to Dining Room
-	//
-	{
-		"f_2bb",
-		{
-			{},
-			{
-				{"x", {0.0f, 0.0f, 25.0f, 100.0f}},			// Left
-				{"x", {33.0f, 0.0f, 33.0f, 100.0f}},		// Forward
-				{"f_2fb", {100.0f, 0.0f, 25.0f, 100.0f}},		// Right
-			}
-		}
-	},
-	//
-	// Stairs, turning left to Kitchen
-	//
-	{
-		"f_2bc",
-		{
-			{},
-			{
-				{"f_2bb", {0.0f, 0.0f, 25.0f, 100.0f}},			// Left
-				{"f_2fc", {100.0f, 0.0f, 25.0f, 100.0f}},		// Right
-			}
-		}
-	},
-	//
-	// Turning left towards Stairs
-	//
-	{
-		"f_2bd",
-		{
-			{},
-			{
-				{"f_2bc", {0.0f, 0.0f, 25.0f, 100.0f}},			// Left
-				{"f_2ba", {100.0f, 0.0f, 25.0f, 100.0f}},		// Right
-			}
-		}
-	},
-	//
-	// Turning right towards Dining Room
-	//
-	{
-		"f_2fa",
-		{
-			{},
-			{
-				{"f_2ba", {0.0f, 0.0f, 25.0f, 100.0f}},			// Left
-				{"f_2fb", {100.0f, 0.0f, 25.0f, 100.0f}},		// Right
-			}
-		}
-	},
-	//
-	// Dining Room, turning right to Kitchen
-	//
-	{
-		"f_2fb",
-		{
-			{},
-			{
-				{"f_2bb", {0.0f, 0.0f, 25.0f, 100.0f}},			// Left
-				{"f_2fc", {100.0f, 0.0f, 25.0f, 100.0f}},		// Right
-			}
-		}
-	},
-	//
-	// Kitchen, turning right to Stairs
-	//
-	{
-		"f_2fc",
-		{
-			{},
-			{
-				{"f_2bb", {0.0f, 0.0f, 25.0f, 100.0f}},			// Left
-				{"x", {33.0f, 0.0f, 33.0f, 100.0f}},		// Forward
-				{"f_2fc", {100.0f, 0.0f, 25.0f, 100.0f}},		// Right
-			}
-		}
-	},
-	//
-	// Stairs, turning right
-	//
-	{
-		"f_2fd",
-		{
-			{},
-			{
-				{"f_2bb", {0.0f, 0.0f, 25.0f, 100.0f}},			// Left
-				{"f_2fc", {100.0f, 0.0f, 25.0f, 100.0f}},		// Right
-			}
-		}
-	},
-
-	////////////////////////////////////////////////////////////////////////
-	// f_3
-	////////////////////////////////////////////////////////////////////////
-
-	/*
-
-	f_3ba
-	f_3bb
-	f_3bc
-	f_3bd
-	f_3fa
-	f_3fb
-	f_3fc
-	f_3fd
-
-	*/
+
+////////////////////////////////////////////////////////////////////////
+// f_1
+////////////////////////////////////////////////////////////////////////
+
+//
+// Turning left towards front door
+//
+inline constexpr Hotspot f_1ba_hotspots[] = {
+	{0.0f, 0.0f, 0.0f, 0.0f, []() { /* Intro Movie */ }},
+	{0.0f, 0.0f, 0.0f, 0.0f, []() { /* Spider Puzzle */ }}
+};
+inline constexpr Navigation f_1ba_navigation[] = {
+	{viewId("f_1bd"), {0.0f, 0.0f, 25.0f, 100.0f}},			// Left
+	{NO_VIEW, {100.0f, 0.0f, 25.0f, 100.0f}}				// Right
+};
+
+//
+// Stairs, turning left
+//
+inline constexpr Navigation f_1bb_navigation[] = {
+	{viewId("f_1ba"), {0.0f, 0.0f, 10.0f, 100.0f}},			// Left
+	{NO_VIEW, {0.0f, 0.0f, 0.0f, 0.0f}},					// Dining Room
+	{viewId("f_1fb"), {90.0f, 0.0f, 10.0f, 100.0f}}			// Right
+};
+
+//
+// turning left towards Stairs *first view
+//
+inline constexpr Navigation f_1bc_navigation[] = {
+	{viewId("f_1bb"), {0.0f, 0.0f, 10.0f, 100.0f}},			// Left
+	{NO_VIEW, {33.0f, 0.0f, 33.0f, 85.0f}},					// Forward
+	{viewId("f_1fc"), {90.0f, 0.0f, 10.0f, 100.0f}},		// Right
+	{NO_VIEW, {0.0f, 50.0f, 17.0f, 30.0f}},					// Dining Room
+	{NO_VIEW, {80.0f, 50.0f, 20.0f, 30.0f}}					// Music Room
+};
+
+//
+// front door, turning left
+//
+inline constexpr Navigation f_1bd_navigation[] = {
+	{NO_VIEW, {0.0f, 0.0f, 10.0f, 100.0f}},					// Left
+	{NO_VIEW, {0.0f, 70.0f, 25.0f, 30.0f}},					// Music Room
+	{NO_VIEW, {33.0f, 33.0f, 5.0f, 30.0f}},					// Library
+	{NO_VIEW, {90.0f, 0.0f, 10.0f, 100.0f}}					// Right
+};
+
+//
+// front door, turning right
+//
+inline constexpr Navigation f_1fa_navigation[] = {
+	{viewId("f_1ba"), {0.0f, 0.0f, 25.0f, 100.0f}},			// Left
+	{viewId("f_1fb"), {100.0f, 0.0f, 25.0f, 100.0f}},		// Right
+	{NO_VIEW, {33.0f, 33.0f, 5.0f, 30.0f}}					// Library
+};
+
+//
+// turning right towards stairs
+//
+inline constexpr Navigation f_1fb_navigation[] = {
+	{viewId("f_1bb"), {0.0f, 0.0f, 10.0f, 100.0f}},			// Left
+	{NO_VIEW, {33.0f, 0.0f, 33.0f, 85.0f}},					// Forward
+	{viewId("f_1fc"), {90.0f, 0.0f, 10.0f, 100.0f}},		// Right
+	{NO_VIEW, {0.0f, 50.0f, 17.0f, 30.0f}},					// Dining Room
+	{NO_VIEW, {80.0f, 50.0f, 20.0f, 30.0f}}					// Music Room
+};
+
+//
+// Stairs, turning right
+//
+inline constexpr Navigation f_1fc_navigation[] = {
+	{viewId("f_1bc"), {0.0f, 0.0f, 10.0f, 100.0f}},			// Left
+	{viewId("f_1fd"), {90.0f, 0.0f, 10.0f, 100.0f}},		// Right
+	{NO_VIEW, {33.0f, 33.0f, 5.0f, 30.0f}}					// Library
+};
+
+//
+// turning right towards front door
+//
+inline constexpr Hotspot f_1fd_hotspots[] = {
+	{0.0f, 0.0f, 0.0f, 0.0f, []() { /* Intro Movie */ }},
+	{0.0f, 0.0f, 0.0f, 0.0f, []() { /* Spider Puzzle */ }}
+};
+inline constexpr Navigation f_1fd_navigation[] = {
+	{viewId("f_1bd"), {0.0f, 0.0f, 25.0f, 100.0f}},			// Left
+	{NO_VIEW, {100.0f, 0.0f, 25.0f, 100.0f}}				// Right
+};
+
+////////////////////////////////////////////////////////////////////////
+// f_2
+////////////////////////////////////////////////////////////////////////
+
+//
+// Dining Room, turning left
+//
+inline constexpr Navigation f_2ba_navigation[] = {
+	{NO_VIEW, {0.0f, 0.0f, 25.0f, 100.0f}},					// Left
+	{NO_VIEW, {33.0f, 0.0f, 33.0f, 100.0f}},				// Forward
+	{NO_VIEW, {100.0f, 0.0f, 25.0f, 100.0f}}				// Right
+};
+
+//
+// Kitchen, turning left to Dining Room
+//
+inline constexpr Navigation f_2bb_navigation[] = {
+	{NO_VIEW, {0.0f, 0.0f, 25.0f, 100.0f}},					// Left
+	{NO_VIEW, {33.0f, 0.0f, 33.0f, 100.0f}},				// Forward
+	{viewId("f_2fb"), {100.0f, 0.0f, 25.0f, 100.0f}}		// Right
+};
+
+//
+// Stairs, turning left to Kitchen
+//
+inline constexpr Navigation f_2bc_navigation[] = {
+	{viewId("f_2bb"), {0.0f, 0.0f, 25.0f, 100.0f}},			// Left
+	{viewId("f_2fc"), {100.0f, 0.0f, 25.0f, 100.0f}}		// Right
+};
+
+//
+// Turning left towards Stairs
+//
+inline constexpr Navigation f_2bd_navigation[] = {
+	{viewId("f_2bc"), {0.0f, 0.0f, 25.0f, 100.0f}},			// Left
+	{viewId("f_2ba"), {100.0f, 0.0f, 25.0f, 100.0f}}		// Right
+};
+
+//
+// Turning right towards Dining Room
+//
+inline constexpr Navigation f_2fa_navigation[] = {
+	{viewId("f_2ba"), {0.0f, 0.0f, 25.0f, 100.0f}},			// Left
+	{viewId("f_2fb"), {100.0f, 0.0f, 25.0f, 100.0f}}		// Right
+};
+
+//
+// Dining Room, turning right to Kitchen
+//
+inline constexpr Navigation f_2fb_navigation[] = {
+	{viewId("f_2bb"), {0.0f, 0.0f, 25.0f, 100.0f}},			// Left
+	{viewId("f_2fc"), {100.0f, 0.0f, 25.0f, 100.0f}}		// Right
+};
+
+//
+// Kitchen, turning right to Stairs
+//
+inline constexpr Navigation f_2fc_navigation[] = {
+	{viewId("f_2bb"), {0.0f, 0.0f, 25.0f, 100.0f}},			// Left
+	{NO_VIEW, {33.0f, 0.0f, 33.0f, 100.0f}},				// Forward
+	{viewId("f_2fc"), {100.0f, 0.0f, 25.0f, 100.0f}}		// Right
+};
+
+//
+// Stairs, turning right
+//
+inline constexpr Navigation f_2fd_navigation[] = {
+	{viewId("f_2bb"), {0.0f, 0.0f, 25.0f, 100.0f}},			// Left
+	{viewId("f_2fc"), {100.0f, 0.0f, 25.0f, 100.0f}}		// Right
+};
+
+////////////////////////////////////////////////////////////////////////
+// f_3
+////////////////////////////////////////////////////////////////////////
+
+/*
+
+f_3ba
+f_3bb
+f_3bc
+f_3bd
+f_3fa
+f_3fb
+f_3fc
+f_3fd
+
+*/
+
+//
+// Foyer and Hallway views
+//
+inline constexpr View f_[] = {
+	{ viewId("f_1ba"), f_1ba_hotspots, f_1ba_navigation },
+	{ viewId("f_1bb"), {}, f_1bb_navigation },
+	{ viewId("f_1bc"), {}, f_1bc_navigation },
+	{ viewId("f_1bd"), {}, f_1bd_navigation },
+	{ viewId("f_1fa"), {}, f_1fa_navigation },
+	{ viewId("f_1fb"), {}, f_1fb_navigation },
+	{ viewId("f_1fc"), {}, f_1fc_navigation },
+	{ viewId("f_1fd"), f_1fd_hotspots, f_1fd_navigation },
+	{ viewId("f_2ba"), {}, f_2ba_navigation },
+	{ viewId("f_2bb"), {}, f_2bb_navigation },
+	{ viewId("f_2bc"), {}, f_2bc_navigation },
+	{ viewId("f_2bd"), {}, f_2bd_navigation },
+	{ viewId("f_2fa"), {}, f_2fa_navigation },
+	{ viewId("f_2fb"), {}, f_2fb_navigation },
+	{ viewId("f_2fc"), {}, f_2fc_navigation },
+	{ viewId("f_2fd"), {}, f_2fd_navigation }
 };
 
 // Further view prefixes ...
@@ -4,13 +4,20 @@
 #define GAME_H
 
 #include <map>
-#include <functional>
+#include <span>
 #include <string>
 #include <chrono>
 
+#include "views.h"
 #include "vdx.h"
+#include "gjd.h"
+#include "playback.h"
+#include "cache.h"
+#include "prefetch.h"
+#include "hittest.h"
 #include "config.h"
 #include "window.h"
+#include "music.h"
 
 /*
 ===============================================================================
@@ -61,16 +68,50 @@ inline const std::map<Room, std::string> ROOM_DATA = {
 //
 // Animation state structure
 //
+// Frames follow a timeline anchored at the start of the clip, so a hitch
+// never shifts the frames after it; late frames are caught up by skipping.
+//
 struct AnimationState {
 	bool isPlaying = false;
-	std::chrono::steady_clock::time_point lastFrameTime;
+	std::chrono::steady_clock::time_point startTime;	// When frame 0 was (or would have been) shown
+	double clockFPS = 24.0;								// Rate the timeline was anchored at
 	size_t totalFrames = 0;
 
+	size_t lateFrames = 0;								// Frames presented a full period or more after they were due
+	size_t droppedFrames = 0;							// Frames skipped to catch up with the timeline
+
 	void reset() {
 		isPlaying = false;
 		totalFrames = 0;
 	}
 
+	void start(std::chrono::steady_clock::time_point now, double fps) {
+		startTime = now;
+		clockFPS = fps;
+	}
+
+	// Re-anchor so frame index keeps its due time when the rate changes mid-clip
+	void retime(double fps, size_t index, std::chrono::steady_clock::time_point now) {
+		if (fps != clockFPS) {
+			startTime = now - std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+				std::chrono::duration<double>(index / fps));
+			clockFPS = fps;
+		}
+	}
+
+	std::chrono::steady_clock::time_point dueTime(size_t index) const {
+		return startTime + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+			std::chrono::duration<double>(index / clockFPS));
+	}
+
+	// Frame the timeline says should be on screen at time t
+	size_t frameAt(std::chrono::steady_clock::time_point t) const {
+		if (t <= startTime) {
+			return 0;
+		}
+		return static_cast<size_t>(std::chrono::duration<double>(t - startTime).count() * clockFPS);
+	}
+
 	std::chrono::microseconds getFrameDuration(double currentFPS) const {
 		return std::chrono::microseconds(static_cast<long long>(1000000.0 / currentFPS));
 	}
@@ -84,14 +125,14 @@ struct Hotspot {
 	float y;
 	float width;
 	float height;
-	std::function<void()> action;
+	void (*action)() = nullptr;
 };
 
 //
 // Navigation points for moving between views
 //
 struct Navigation {
-	std::string next_view;
+	ViewId next_view;
 	Hotspot hotspot;
 };
 
@@ -99,8 +140,9 @@ struct Navigation {
 // View structure for each camera/viewpoint
 //
 struct View {
-	std::vector<Hotspot> hotspots;
-	std::vector<Navigation> navigations;
+	ViewId id;
+	std::span<const Hotspot> hotspots;
+	std::span<const Navigation> navigations;
 };
 
 //
@@ -117,17 +159,26 @@ struct GameState {
 	} ui;
 
 	double currentFPS = 24.0;						// Current target FPS, adjustable during gameplay
-	std::vector<VDXFile> VDXFiles;				    // Vector of VDXFile objects
+	std::map<Room, GJDArchive> archives;			// Every room visited so far, opened once
+	GJDArchive* archive = nullptr;					// Archive of the current room
 	size_t currentFrameIndex = 30;				    // Normally 0 - hard-coded to 30 for testing
 	VDXFile* currentVDX = nullptr;				    // Reference to current VDXFile object
 	AnimationState animation;						// Animation state management
 
 	Room current_room = Room::FOYER_HALLWAY;        // Default room (corresponds to ROOM_DATA map key)
 	Room previous_room;			                    // Avoid re-rendering
-	std::string current_view = "f_1bc";		        // Default view (corresponds to VDXFile .filename struct member)
-	std::string previous_view = "f_1bc";	        // Avoid re-rendering
-
-	View view;										// Current view object
+	ViewId current_view = viewId("f_1bc");		    // Default view (its name is the VDXFile .filename struct member)
+	ViewId previous_view = viewId("f_1bc");	        // Avoid re-rendering
+
+	const View* view = nullptr;						// Current view object
+	HitGrid hitGrid;								// Navigations and hotspots of view, bucketed for hit-testing
+	DirtyTiles dirty;								// Tiles changed since the renderer last uploaded
+	bool gpuTileDecode = false;						// Renderer expands 0x20 tiles itself (Vulkan compute)
+
+	MusicPlayer music;								// Room themes, played from their own thread
+	ClipCache clipCache;							// Decoded clips of every room, keyed by (room, view)
+	Prefetcher prefetch{ clipCache };				// Warms the current view's navigation targets
+	FramePipeline playback;							// Background decoder for currentVDX (last, so it stops before archive)
 };
 
 //=============================================================================
@@ -137,10 +188,13 @@ extern GameState state;
 //=============================================================================
 
 // Function prototypes
-const View* getView(const std::string& current_view);
+const View* getView(ViewId id);
 void loadView();
+void prefetchNavigations();
 void handleClick();
 void updateAnimation();
+const IndexedFrame* currentFrame();
+HitTarget hitTestCursor();
 void init();
 
 #endif // GAME_H
\ No newline at end of file
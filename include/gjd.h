@@ -5,21 +5,46 @@
 
 #include <vector>
 #include <string>
+#include <memory>
+#include <unordered_map>
 
+#include "rl.h"
 #include "vdx.h"
+#include "mapped.h"
+#include "gjdindex.h"
 
 /*
 ===============================================================================
 
     7th Guest - GJD Parser
 
-    This header file contains the function prototype for parsing a GJD file
-    to get the VDX file data.
+    This header file contains the function prototypes for parsing a GJD file
+    to get the VDX file data, either all at once or one view at a time
+    through an archive indexed by its RL table. Both go through the cached
+    GJD index, so chunk headers are never re-scanned.
 
 ===============================================================================
 */
 
-// Function prototype for parseGJDFile
+// RL/GJD pair indexed by view name, parsing each VDX only when requested
+struct GJDArchive
+{
+    std::string gjdFilename;
+    GJDIndex gjdIndex;                                  // Chunk tables, parallel to entries
+    std::vector<RLEntry> entries;
+    std::unordered_map<std::string, size_t> index;      // View name -> entries[]
+    std::shared_ptr<const MappedFile> mapping;          // nullptr if the GJD could not be mapped
+    std::unordered_map<std::string, VDXFile> loaded;    // Views parsed so far
+
+    const RLEntry* find(const std::string& name) const;
+    VDXFile* getVDX(const std::string& name);
+    bool readVDX(size_t entry, VDXFile& vdxFile) const;
+};
+
+// Function prototypes
 std::vector<VDXFile> parseGJDFile(const std::string& rlFilename);
+GJDArchive openGJDArchive(const std::string& rlFilename, bool required = true);
+std::string gjdFilenameFor(const std::string& rlFilename);
+std::string vdxNameFor(const RLEntry& entry);
 
 #endif // GJD_H
\ No newline at end of file
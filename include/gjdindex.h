@@ -0,0 +1,80 @@
+// gjdindex.h
+
+#ifndef GJDINDEX_H
+#define GJDINDEX_H
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+
+/*
+===============================================================================
+
+    7th Guest - GJD Index Cache
+
+    A binary table of contents for an RL/GJD pair, stored next to the RL
+    file as <name>.IDX. It holds every RL record and, for VDX entries, the
+    header of every chunk, so opening an archive or listing it reads one
+    small mapped file instead of the RL records and the chunk headers
+    scattered through the GJD.
+
+    The index records the size and modification time of both files and is
+    rebuilt whenever either has changed. If it cannot be written, the
+    freshly built index is used from memory.
+
+===============================================================================
+*/
+
+struct GJDIndexHeader
+{
+    char magic[4];              // "7GIX"
+    uint32_t version;
+    uint64_t rlSize;
+    int64_t rlTime;
+    uint64_t gjdSize;
+    int64_t gjdTime;
+    uint32_t entryCount;
+    uint32_t chunkCount;
+};
+
+struct GJDIndexEntry
+{
+    char filename[12];          // As stored in the RL record, NUL padded
+    uint32_t offset;            // Into the GJD
+    uint32_t length;
+    uint16_t identifier;        // VDX header, zero for other entries
+    uint8_t unknown[6];
+    uint32_t firstChunk;        // Into GJDIndex::chunks
+    uint32_t chunkCount;        // Zero for entries that are not VDX files
+};
+
+struct GJDIndexChunk
+{
+    uint8_t chunkType;
+    uint8_t unknown;
+    uint8_t lengthMask;
+    uint8_t lengthBits;
+    uint32_t dataSize;
+    uint32_t offset;            // Of the payload, from the start of the VDX
+};
+
+static_assert(sizeof(GJDIndexHeader) == 48 && sizeof(GJDIndexEntry) == 36 && sizeof(GJDIndexChunk) == 12,
+    "GJD index records are read straight from the file");
+
+struct GJDIndex
+{
+    std::shared_ptr<const void> storage;    // Mapped *.IDX file or in-memory copy
+    std::span<const GJDIndexEntry> entries;
+    std::span<const GJDIndexChunk> chunks;
+
+    std::span<const GJDIndexChunk> chunksOf(const GJDIndexEntry& entry) const
+    {
+        return chunks.subspan(entry.firstChunk, entry.chunkCount);
+    }
+};
+
+GJDIndex loadGJDIndex(const std::string& rlFilename);
+std::string indexFilenameFor(const std::string& rlFilename);
+
+#endif // GJDINDEX_H
\ No newline at end of file
@@ -0,0 +1,57 @@
+// hittest.h
+
+#ifndef HITTEST_H
+#define HITTEST_H
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+struct View;
+struct Navigation;
+struct Hotspot;
+
+/*
+===============================================================================
+
+    7th Guest - Hit-Test Grid
+
+    Hotspot and navigation rectangles are given in percent of the client
+    area. HitGrid buckets them into a coarse grid over the 640x320 frame
+    once per view, so a cursor query only checks the few rectangles that
+    overlap its cell instead of every rectangle in the view.
+
+    Navigations take priority over hotspots, and within each kind the
+    first rectangle in the view wins, matching the order of View.
+
+===============================================================================
+*/
+
+// What the cursor is over; at most one member is set
+struct HitTarget
+{
+    const Navigation* navigation = nullptr;
+    const Hotspot* hotspot = nullptr;
+
+    explicit operator bool() const { return navigation || hotspot; }
+};
+
+class HitGrid
+{
+public:
+    static constexpr int columns = 640 / 16;    // 16x16 frame pixels per cell
+    static constexpr int rows = 320 / 16;
+
+    void build(const View& view);
+    HitTarget query(float percentX, float percentY) const;
+
+private:
+    const View* view = nullptr;
+
+    // Cell c lists entries[offsets[c] .. offsets[c + 1]) in priority order;
+    // an entry is a navigation index, or navigations.size() + a hotspot index
+    std::array<uint32_t, columns * rows + 1> offsets{};
+    std::vector<uint16_t> entries;
+};
+
+#endif // HITTEST_H
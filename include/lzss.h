@@ -6,6 +6,7 @@
 #include <vector>
 #include <cstdint>
 #include <string>
+#include <span>
 
 #include "vdx.h"
 
@@ -14,14 +15,22 @@
 
     7th Guest - LZSS Decompression
 
-    This header file contains the function prototype for LZSS decompression
-    used for decompressing VDX data.
+    This header file contains the function prototypes for LZSS compression
+    and decompression of VDX chunk data.
 
 ===============================================================================
 */
 
+// Match-finder effort used by lzssCompress
+enum class LZSSLevel
+{
+    Fast,       // Greedy parse over a short hash chain
+    Optimal     // Exhaustive window search with a minimum-cost parse
+};
+
 // Function prototypes
-std::vector<uint8_t> lzssCompress(const std::vector<uint8_t>& inputData, uint8_t lengthMask, uint8_t lengthBits);
-std::vector<uint8_t> lzssDecompress(const std::vector<uint8_t>& compressedData, uint8_t lengthMask, uint8_t lengthBits);
+std::vector<uint8_t> lzssCompress(const std::vector<uint8_t>& inputData, uint8_t lengthMask, uint8_t lengthBits, LZSSLevel level = LZSSLevel::Optimal);
+std::vector<uint8_t> lzssDecompress(std::span<const uint8_t> compressedData, uint8_t lengthMask, uint8_t lengthBits);
+size_t lzssDecompress(std::span<const uint8_t> compressedData, uint8_t lengthMask, uint8_t lengthBits, std::span<uint8_t> output);
 
 #endif // LZSS_H
\ No newline at end of file
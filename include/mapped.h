@@ -0,0 +1,40 @@
+// mapped.h
+
+#ifndef MAPPED_H
+#define MAPPED_H
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+
+/*
+===============================================================================
+
+    7th Guest - Memory-Mapped Files
+
+    Read-only file mappings for the GJD archives. VDX chunks are parsed as
+    views into the mapping, so the archive is paged in by the OS on demand
+    rather than copied into the heap.
+
+===============================================================================
+*/
+
+struct MappedFile
+{
+    void* file = nullptr;
+    void* mapping = nullptr;
+    const uint8_t* view = nullptr;
+    size_t size = 0;
+
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+    std::span<const uint8_t> data() const { return { view, size }; }
+};
+
+std::shared_ptr<const MappedFile> mapFile(const std::string& filename);
+
+#endif // MAPPED_H
\ No newline at end of file
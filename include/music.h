@@ -0,0 +1,96 @@
+// music.h
+
+#ifndef MUSIC_H
+#define MUSIC_H
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+===============================================================================
+
+    7th Guest - Music Engine
+
+    Songs are converted from XMI once, on the music thread, into a flat
+    buffer of stream events (one MIDIEVENT per message, tempo changes
+    included) and kept for the rest of the session.
+
+    The music thread owns a midiStream and keeps two MIDIHDR blocks of
+    that buffer queued on it, refilling each one as the driver hands it
+    back, so the game loop never touches the MIDI device. Songs loop
+    until they are replaced or stopped.
+
+    Switching songs fades the current one out by scaling every channel's
+    volume (CC 7), restarts the stream on the new song and fades it in.
+    A General MIDI synth has one set of channels, so the two songs never
+    overlap; the fade is what hides the cut.
+
+===============================================================================
+*/
+
+// Same layout as a short-message MIDIEVENT
+struct MidiEvent
+{
+    uint32_t deltaTime;                 // Ticks since the previous event
+    uint32_t streamId;                  // Always 0
+    uint32_t event;                     // MEVT_SHORTMSG or MEVT_TEMPO in the top byte, message below
+};
+
+struct MidiSequence
+{
+    uint16_t timebase = 0;              // Ticks per quarter note
+    uint64_t length = 0;                // Ticks from the start to the end of the track
+    std::vector<MidiEvent> events;      // In time order; the last one runs to the end of the track
+};
+
+MidiSequence parseMidiSequence(std::span<const uint8_t> midiData);
+
+class MusicPlayer
+{
+public:
+    static constexpr size_t blockEvents = 512;      // Events per MIDIHDR block
+
+    MusicPlayer() = default;
+    MusicPlayer(const MusicPlayer&) = delete;
+    MusicPlayer& operator=(const MusicPlayer&) = delete;
+    ~MusicPlayer();
+
+    void play(const std::string& song, int fadeMs = 1000);
+    void play(std::shared_ptr<const MidiSequence> sequence, int fadeMs = 1000);
+    void stop(int fadeMs = 1000);
+    void setVolume(int percent);
+    void shutdown();
+
+    const std::string& current() const { return currentSong; }
+
+private:
+    struct Request
+    {
+        bool pending = false;
+        std::string song;                               // Empty with no sequence: stop
+        std::shared_ptr<const MidiSequence> sequence;   // Set for an already converted song
+        int fadeMs = 0;
+    };
+
+    void request(Request next);
+    void run();
+    std::shared_ptr<const MidiSequence> load(const std::string& song);
+
+    std::mutex mutex;                   // Guards pending, volume and quit
+    Request pending;
+    int volume = 100;
+    bool quit = false;
+    void* wake = nullptr;               // Win32 event: request made or a block came back
+
+    std::string currentSong;            // Main thread's view of what is playing
+    std::map<std::string, std::shared_ptr<const MidiSequence>> songs;  // Music thread only
+    std::thread worker;
+};
+
+#endif // MUSIC_H
\ No newline at end of file
@@ -0,0 +1,39 @@
+// pixel.h
+
+#ifndef PIXEL_H
+#define PIXEL_H
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "bitmap.h"
+
+/*
+===============================================================================
+
+    7th Guest - Pixel Conversion
+
+    Conversion kernels shared by the renderers: packed RGB to BGRA, and
+    8-bit palette indices to BGRA through a 256-entry lookup table.
+
+    Each kernel has an AVX2 and/or SSSE3 version next to the scalar one;
+    the fastest the CPU supports is picked once at startup.
+
+===============================================================================
+*/
+
+using BGRALookup = std::array<uint32_t, 256>;
+
+BGRALookup buildBGRALookup(std::span<const RGBColor> palette);
+void convertRGBToBGRA(std::span<const uint8_t> rgb, std::span<uint32_t> bgra);
+void convertIndexedToBGRA(std::span<const uint8_t> indices, const BGRALookup& lut, std::span<uint32_t> bgra);
+
+void expandToBGRA(const IndexedFrame& frame, std::span<uint32_t> output);
+void expandToBGRA(const IndexedFrame& frame, std::span<uint32_t> output, std::span<const PixelRect> rects);
+
+std::span<uint32_t> bgraScratch(size_t pixels);
+const char* pixelKernelName();
+
+#endif // PIXEL_H
\ No newline at end of file
@@ -0,0 +1,85 @@
+// playback.h
+
+#ifndef PLAYBACK_H
+#define PLAYBACK_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <semaphore>
+#include <span>
+#include <thread>
+#include <vector>
+
+#include "vdx.h"
+
+/*
+===============================================================================
+
+    7th Guest - Frame Playback Pipeline
+
+    A worker thread decodes the frames of the current VDX file ahead of time
+    into a fixed ring of frame buffers. The main thread only ever steps to
+    the next ready frame, so LZSS and delta decoding never compete with the
+    message loop.
+
+    A clip can also be started from a WarmClip whose first frames were
+    decoded earlier (see prefetch.h); those go straight into the ring.
+
+    The ring is single-producer/single-consumer: the worker publishes frames
+    by bumping tail, the main thread owns head (the frame on screen). A
+    semaphore counting free slots lets the worker sleep while the ring is
+    full.
+
+===============================================================================
+*/
+
+// Frame plus the tiles that changed since the frame before it
+struct DecodedFrame
+{
+    IndexedFrame frame;
+    DirtyTiles dirty;
+};
+
+// Clip with its first frames already decoded, and a stream positioned after them
+struct WarmClip
+{
+    std::vector<DecodedFrame> frames;           // At most FramePipeline::capacity
+    VDXStream stream;
+
+    size_t bytes() const;
+};
+
+class FramePipeline
+{
+public:
+    static constexpr size_t capacity = 8;   // Frames in flight, including the one on screen
+
+    FramePipeline() = default;
+    FramePipeline(const FramePipeline&) = delete;
+    FramePipeline& operator=(const FramePipeline&) = delete;
+    ~FramePipeline();
+
+    void start(const VDXFile& vdxFile, bool deferTiles = false);
+    void start(WarmClip clip);
+    void stop();
+
+    bool advance();
+    bool finished() const;
+    const DecodedFrame* current() const;
+    size_t currentIndex() const { return head; }
+
+private:
+    void decode(VDXStream stream);
+    void publish(const VDXStream& stream);
+
+    std::array<DecodedFrame, capacity> ring;
+    std::counting_semaphore<> freeSlots{ capacity };
+    std::atomic<size_t> tail{ 0 };          // Frames published by the worker
+    std::atomic<bool> done{ false };        // Worker reached the end of the clip
+    std::atomic<bool> cancel{ false };
+    size_t head = 0;                        // Frame on screen, owned by the main thread
+    std::thread worker;
+};
+
+#endif // PLAYBACK_H
\ No newline at end of file
@@ -0,0 +1,119 @@
+// pngwriter.h
+
+#ifndef PNGWRITER_H
+#define PNGWRITER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <zlib.h>
+
+#include "bitmap.h"
+
+/*
+===============================================================================
+
+    7th Guest - PNG Encoder and Asynchronous File Writer
+
+    PNGEncoder writes 8-bit RGB or palette-indexed (PLTE) PNGs into a
+    memory buffer. It keeps its zlib stream and filter scratch between
+    images, so encoding a clip allocates nothing after the first frame.
+
+    AsyncFileWriter puts encoded buffers on disk from a background thread
+    and hands the emptied buffers back for reuse, so decoding, encoding
+    and disk I/O overlap.
+
+===============================================================================
+*/
+
+enum class PNGFilter : uint8_t
+{
+    None,
+    Sub,
+    Up,
+    Paeth,
+    Adaptive        // Per row, whichever filter has the smallest sum of absolute values
+};
+
+struct PNGOptions
+{
+    int level = Z_DEFAULT_COMPRESSION;      // zlib level, 0-9
+    PNGFilter filter = PNGFilter::Adaptive; // RGB only; indexed images are never filtered
+    bool indexed = false;                   // Write the frame palette as PLTE and one byte per pixel
+
+    static PNGOptions fast() { return { Z_BEST_SPEED, PNGFilter::Up, false }; }
+    static PNGOptions smallest() { return { Z_BEST_COMPRESSION, PNGFilter::Adaptive, false }; }
+};
+
+class PNGEncoder
+{
+public:
+    explicit PNGEncoder(const PNGOptions& options = {});
+    PNGEncoder(const PNGEncoder&) = delete;
+    PNGEncoder& operator=(const PNGEncoder&) = delete;
+    ~PNGEncoder();
+
+    void setOptions(const PNGOptions& newOptions);
+    const PNGOptions& getOptions() const { return options; }
+
+    void encode(const IndexedFrame& frame, std::vector<uint8_t>& out);
+    void encodeRGB(const uint8_t* rgb, int width, int height, std::vector<uint8_t>& out);
+
+private:
+    void encodeImage(const uint8_t* pixels, int width, int height, int bytesPerPixel,
+                     const std::array<RGBColor, 256>* palette, std::vector<uint8_t>& out);
+    void filterRows(const uint8_t* pixels, int width, int height, int bytesPerPixel, PNGFilter filter);
+
+    PNGOptions options;
+    z_stream zstream{};
+    std::vector<uint8_t> filtered;          // Filter byte + filtered bytes, per row
+    std::vector<uint8_t> candidates;        // Adaptive filtering: one trial row per filter
+};
+
+class AsyncFileWriter
+{
+public:
+    explicit AsyncFileWriter(size_t maxQueuedBytes = 64 * 1024 * 1024);
+    AsyncFileWriter(const AsyncFileWriter&) = delete;
+    AsyncFileWriter& operator=(const AsyncFileWriter&) = delete;
+    ~AsyncFileWriter();
+
+    std::vector<uint8_t> acquire();
+    void write(std::filesystem::path path, std::vector<uint8_t> data);
+    void flush();
+
+    uint64_t bytesWritten() const { return written.load(std::memory_order_relaxed); }
+    size_t filesWritten() const { return files.load(std::memory_order_relaxed); }
+    size_t failures() const { return failed.load(std::memory_order_relaxed); }
+
+private:
+    struct Job
+    {
+        std::filesystem::path path;
+        std::vector<uint8_t> data;
+    };
+
+    void run();
+
+    const size_t maxQueuedBytes;
+    std::mutex mutex;
+    std::condition_variable wake;           // Job queued or quit
+    std::condition_variable space;          // Queue shrank or went idle
+    std::deque<Job> queue;
+    size_t queuedBytes = 0;
+    bool busy = false;                      // Worker is writing a job it has already dequeued
+    bool quit = false;
+    std::vector<std::vector<uint8_t>> spare;    // Written buffers, kept for their capacity
+    std::atomic<uint64_t> written{ 0 };
+    std::atomic<size_t> files{ 0 };
+    std::atomic<size_t> failed{ 0 };
+    std::thread worker;
+};
+
+#endif // PNGWRITER_H
\ No newline at end of file
@@ -0,0 +1,62 @@
+// prefetch.h
+
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cache.h"
+#include "vdx.h"
+
+/*
+===============================================================================
+
+    7th Guest - View Prefetcher
+
+    Once a view is on screen the player can only go to one of its
+    navigation targets, so their clips are decoded ahead of time on a
+    background thread. Each warm clip holds the first frames of the clip
+    (one ring's worth) and the stream to continue from, so a click starts
+    the transition without touching the decoder.
+
+    Warm clips go into the shared ClipCache, which owns the memory budget.
+
+===============================================================================
+*/
+
+class Prefetcher
+{
+public:
+    struct Target
+    {
+        ClipCache::Key key;
+        const VDXFile* vdxFile;         // Must outlive the prefetcher
+        bool deferTiles = false;        // See openVDXStream
+    };
+
+    explicit Prefetcher(ClipCache& cache) : cache(cache) {}
+    Prefetcher(const Prefetcher&) = delete;
+    Prefetcher& operator=(const Prefetcher&) = delete;
+    ~Prefetcher();
+
+    void request(std::vector<Target> targets);
+
+private:
+    void run();
+
+    ClipCache& cache;
+    std::mutex mutex;
+    std::condition_variable wake;       // Work queued or quit
+    std::deque<Target> queue;
+    uint64_t generation = 0;            // Bumped by request() to abandon stale work
+    bool quit = false;
+    std::thread worker;
+};
+
+#endif // PREFETCH_H
\ No newline at end of file
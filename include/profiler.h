@@ -0,0 +1,122 @@
+// profiler.h
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*
+===============================================================================
+
+    7th Guest - Frame Profiler
+
+    devMode only. ScopedTimer times a block on whichever thread it runs
+    (main loop, frame pipeline, prefetcher) and hands the span to the
+    profiler, which keeps two ring buffers:
+
+    - Per frame: the time since the previous present and the time spent in
+      each scope during it, for the on-screen overlay (F3).
+    - Every span, for a Chrome trace (F4, or "traceFile" on exit) that
+      opens in chrome://tracing or ui.perfetto.dev.
+
+    While disabled a ScopedTimer costs one relaxed load.
+
+===============================================================================
+*/
+
+enum class ProfileScope : uint8_t
+{
+    LoadView,
+    Events,                             // processEvents
+    LZSS,
+    Bitmap,                             // 0x20 tiles
+    Delta,                              // 0x25 opcodes
+    Convert,                            // Palette indices -> BGRA
+    Upload,
+    Present,
+    Count
+};
+
+struct ProfileFrame
+{
+    double frameMs = 0.0;                                   // Since the previous present
+    std::array<double, size_t(ProfileScope::Count)> scopeMs{};  // Summed over every thread
+
+    double decodeMs() const;
+};
+
+// Coloured rectangle in window pixels; the renderers just fill them
+struct OverlayRect
+{
+    int x, y, width, height;
+    uint32_t color;                     // 0xRRGGBB
+};
+
+class Profiler
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr size_t frameHistory = 240;             // Frames in the overlay graph
+    static constexpr size_t eventCapacity = 1 << 16;        // Spans kept for the trace; oldest go first
+
+    bool overlay = false;               // Overlay drawn by the renderers (main thread)
+
+    void enable(bool on);
+    bool enabled() const { return active.load(std::memory_order_relaxed); }
+
+    void record(ProfileScope scope, Clock::time_point start, Clock::time_point end);
+    void endFrame();
+    void restartFrame();
+
+    std::vector<ProfileFrame> frames() const;
+    bool writeTrace(const std::string& filename) const;
+
+private:
+    struct Span
+    {
+        ProfileScope scope;
+        uint32_t thread;
+        int64_t start;                  // Microseconds since epoch
+        int64_t duration;
+    };
+
+    mutable std::mutex mutex;           // Guards everything below
+    std::atomic<bool> active{ false };
+    Clock::time_point epoch = Clock::now();
+
+    std::vector<Span> spans;            // Ring of eventCapacity, allocated on enable
+    size_t spanCount = 0;               // Spans recorded in total
+
+    std::array<ProfileFrame, frameHistory> history{};
+    size_t frameCount = 0;              // Frames ended in total
+    ProfileFrame pending;               // Frame in progress
+    Clock::time_point lastPresent;
+};
+
+class ScopedTimer
+{
+public:
+    explicit ScopedTimer(ProfileScope scope);
+    ~ScopedTimer() { stop(); }
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+    void stop();
+
+private:
+    ProfileScope scope;
+    Profiler::Clock::time_point start;  // Default (epoch 0) when not timing
+};
+
+extern Profiler profiler;
+
+std::vector<OverlayRect> buildProfilerOverlay();
+
+#endif // PROFILER_H
\ No newline at end of file
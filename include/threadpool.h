@@ -0,0 +1,67 @@
+// threadpool.h
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+===============================================================================
+
+    7th Guest - Work-stealing Thread Pool
+
+    Every worker owns a deque of tasks. Tasks submitted from inside a task
+    go to the back of the submitting worker's own deque and are taken
+    newest-first by their owner, which keeps a clip's frames on the core
+    that decoded them. Idle workers steal the oldest task from another
+    worker, so one long clip cannot leave the rest of the pool idle.
+
+    Tasks must not throw.
+
+===============================================================================
+*/
+
+class ThreadPool
+{
+public:
+    using Task = std::function<void()>;
+
+    explicit ThreadPool(unsigned threadCount = std::thread::hardware_concurrency());
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    ~ThreadPool();
+
+    void submit(Task task);
+    void wait();
+    size_t size() const { return queues.size(); }
+
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    bool pop(size_t self, Task& task);
+    bool steal(size_t self, Task& task);
+    void run(size_t self);
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+    std::atomic<size_t> queued{ 0 };        // Tasks waiting in any deque
+    std::atomic<size_t> pending{ 0 };       // Tasks submitted but not finished
+    std::atomic<size_t> nextQueue{ 0 };     // Round-robin target for outside submits
+    std::mutex sleepMutex;
+    std::condition_variable wake;           // Work queued or quit
+    std::condition_variable idle;           // pending dropped to zero
+    bool quit = false;
+};
+
+#endif // THREADPOOL_H
\ No newline at end of file
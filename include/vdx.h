@@ -7,6 +7,8 @@
 #include <vector>
 #include <array>
 #include <string>
+#include <span>
+#include <memory>
 
 #include "bitmap.h"
 
@@ -29,7 +31,8 @@ struct VDXChunk
     uint32_t dataSize;
     uint8_t lengthMask;
     uint8_t lengthBits;
-    std::vector<uint8_t> data;
+    std::span<const uint8_t> raw;       // Chunk payload as stored, viewed in VDXFile::storage
+    std::vector<uint8_t> data;          // Decoded payload, filled in by parseVDXChunks
 };
 
 // VDXFile struct
@@ -39,11 +42,32 @@ struct VDXFile
     uint16_t identifier;
     std::array<uint8_t, 6> unknown;
     std::vector<VDXChunk> chunks;
+    std::shared_ptr<const void> storage;    // Keeps the bytes behind every chunk.raw alive
     bool parsed = false;
 };
 
-VDXFile parseVDXFile(const std::string& filename, const std::vector<uint8_t>& buffer);
+// Incremental decoder that keeps only the current frame of a VDXFile
+struct VDXStream
+{
+    const VDXFile* vdxFile = nullptr;
+    size_t nextChunk = 0;                   // Next chunk to examine
+    size_t framesDecoded = 0;
+    IndexedFrame frame;                     // Current frame, 640x320 palette indices
+    DirtyTiles dirty;                       // What the last next() changed in frame
+    std::vector<uint8_t> scratch;           // LZSS output of the chunk being decoded
+    bool deferTiles = false;                // Leave 0x20 frames as frame.tiles until a delta needs them
+
+    bool next();
+};
+
+VDXFile parseVDXFile(const std::string& filename, std::span<const uint8_t> buffer, std::shared_ptr<const void> storage);
+VDXFile parseVDXFile(const std::string& filename, std::vector<uint8_t> buffer);
+size_t maxDecompressedSize(uint8_t chunkType);
 void parseVDXChunks(VDXFile& vdxFile);
+VDXStream openVDXStream(const VDXFile& vdxFile, bool deferTiles = false);
+size_t countVDXFrames(const VDXFile& vdxFile);
+VDXFile packVDXFile(const std::string& filename, const std::vector<std::vector<uint8_t>>& frames,
+                    const std::vector<RGBColor>& palette, int width = 640, int height = 320);
 void writeVDXFile(const VDXFile& vdxFile, const std::string& outputDir);
 
 #endif // VDX_H
\ No newline at end of file
@@ -0,0 +1,70 @@
+// views.h
+
+#ifndef VIEWS_H
+#define VIEWS_H
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+/*
+===============================================================================
+
+	7th Guest - View IDs
+
+	Every view the engine knows about is interned here once, so the rest of
+	the engine refers to views by a small integer instead of by name. IDs
+	are resolved at compile time with viewId(), which rejects unknown names.
+
+	The name of a view is also the name of its VDX file in the room's GJD.
+
+===============================================================================
+*/
+
+using ViewId = uint16_t;
+
+inline constexpr ViewId NO_VIEW = 0xFFFF;			// Navigation target not implemented yet
+
+//
+// View names, indexed by ViewId
+//
+inline constexpr auto VIEW_NAMES = std::to_array<std::string_view>({
+	// Foyer and Hallway
+	"f_1ba",
+	"f_1bb",
+	"f_1bc",
+	"f_1bd",
+	"f_1fa",
+	"f_1fb",
+	"f_1fc",
+	"f_1fd",
+	"f_2ba",
+	"f_2bb",
+	"f_2bc",
+	"f_2bd",
+	"f_2fa",
+	"f_2fb",
+	"f_2fc",
+	"f_2fd"
+});
+
+//
+// ID of a view by name, at compile time
+//
+consteval ViewId viewId(std::string_view name) {
+	for (size_t i = 0; i < VIEW_NAMES.size(); ++i) {
+		if (VIEW_NAMES[i] == name) {
+			return static_cast<ViewId>(i);
+		}
+	}
+	throw "Unknown view name";
+}
+
+//
+// Name of a view, which is also the name of its VDX file
+//
+constexpr std::string_view viewName(ViewId id) {
+	return id < VIEW_NAMES.size() ? VIEW_NAMES[id] : std::string_view{};
+}
+
+#endif // VIEWS_H
\ No newline at end of file
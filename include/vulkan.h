@@ -2,10 +2,31 @@
 #define VULKAN_H
 
 #include <vector>
+#include <array>
 #include <string>
 #include <GLFW/glfw3.h>
+
+#define VK_USE_PLATFORM_WIN32_KHR
 #include <vulkan/vulkan.h>
 
+constexpr uint32_t MAX_FRAMES_IN_FLIGHT = 3;
+
+// Staging layout: the 640x320 index plane, then the 256-entry BGRA palette
+constexpr VkDeviceSize INDEX_PLANE_SIZE = 640 * 320;
+constexpr VkDeviceSize PALETTE_SIZE = 256 * sizeof(uint32_t);
+
+// Persistently mapped staging buffer and its command buffer, one per frame in flight
+struct VulkanUploadSlot {
+    VkBuffer stagingBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory stagingMemory = VK_NULL_HANDLE;
+    void* mapped = nullptr;
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+    VkFence fence = VK_NULL_HANDLE;             // Signalled once the GPU is done with this slot
+    VkSemaphore imageAvailable = VK_NULL_HANDLE;
+    VkSemaphore renderFinished = VK_NULL_HANDLE;
+    VkDescriptorSet tileDescriptorSet = VK_NULL_HANDLE;    // Reads this slot's staging buffer as a tile stream
+};
+
 struct VulkanContext {
     VkInstance instance;
     VkPhysicalDevice physicalDevice;
@@ -13,25 +34,58 @@ struct VulkanContext {
     VkQueue graphicsQueue;
     VkCommandPool commandPool;
 
-    VkImage textureImage;
+    VkSurfaceKHR surface;
+    VkSwapchainKHR swapchain = VK_NULL_HANDLE;
+    VkFormat swapchainFormat;
+    VkExtent2D swapchainExtent;
+    std::vector<VkImage> swapchainImages;
+    std::vector<VkImageView> swapchainImageViews;
+    std::vector<VkFramebuffer> framebuffers;
+
+    VkImage textureImage;                       // R8_UINT palette indices
     VkDeviceMemory textureImageMemory;
     VkImageView textureImageView;
     VkSampler textureSampler;
+    VkImageLayout textureLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    VkBuffer paletteBuffer;                     // Uniform buffer, PALETTE_SIZE bytes
+    VkDeviceMemory paletteBufferMemory;
+
+    VkDescriptorSetLayout descriptorSetLayout;
+    VkDescriptorPool descriptorPool;
+    VkDescriptorSet descriptorSet;
 
     VkPipelineLayout pipelineLayout;
     VkPipeline graphicsPipeline;
     VkRenderPass renderPass;
 
+    bool tileDecode = false;                    // 0x20 tiles are expanded by the compute pipeline
+    VkDescriptorSetLayout tileDescriptorSetLayout = VK_NULL_HANDLE;
+    VkDescriptorPool tileDescriptorPool = VK_NULL_HANDLE;
+    VkPipelineLayout tilePipelineLayout = VK_NULL_HANDLE;
+    VkPipeline tilePipeline = VK_NULL_HANDLE;
+
     VkBuffer vertexBuffer;
     VkDeviceMemory vertexBufferMemory;
     VkBuffer indexBuffer;
     VkDeviceMemory indexBufferMemory;
 
     uint32_t graphicsQueueFamily;
+
+    std::array<VulkanUploadSlot, MAX_FRAMES_IN_FLIGHT> uploads;
+    uint32_t currentUpload = 0;
 };
 
 void initializeVulkan();
 void createVulkanTexture(const uint8_t* pixels, uint32_t width, uint32_t height);
+void createSwapchain();
+void createRenderPass();
+void createFramebuffers();
+void createDescriptors();
+void createGraphicsPipeline();
+void createUploadRing();
+void createTilePipeline();
+void recreateSwapchain();
 void renderFrameVk();
 void cleanupVulkan();
 
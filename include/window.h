@@ -5,6 +5,7 @@
 
 #include <vector>
 #include <string>
+#include <chrono>
 #include <windows.h>
 
 #include "config.h"
@@ -39,6 +40,7 @@ void initWindow();
 void initMenu();
 void renderFrame();
 bool processEvents();
+void waitForEvents(std::chrono::steady_clock::time_point deadline);
 void cleanupWindow();
 
 #endif // WINDOW_H
\ No newline at end of file
@@ -4,8 +4,12 @@
 #define XMI_H
 
 #include <string>
+#include <span>
+#include <vector>
+#include <cstdint>
 
 #include "rl.h"
+#include "gjd.h"
 
 /*
 ===============================================================================
@@ -17,7 +21,9 @@
 ===============================================================================
 */
 
+const GJDArchive& xmiArchive();
 std::vector<uint8_t> xmiConverter(const RLEntry& song);
+std::vector<uint8_t> xmiConverter(std::span<const uint8_t> xmiFile);
 void PlayMIDI(const std::vector<uint8_t>& midiData);
 
 #endif
\ No newline at end of file
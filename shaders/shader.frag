@@ -0,0 +1,23 @@
+#version 450
+
+// Expands the 8-bit palette index plane to colour
+
+layout(binding = 0) uniform usampler2D indexTexture;
+
+// 256 BGRA8 entries, packed four per uvec4 to satisfy std140 array stride
+layout(binding = 1) uniform Palette {
+    uvec4 entries[64];
+} palette;
+
+layout(location = 0) in vec2 fragTexCoord;
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    ivec2 size = textureSize(indexTexture, 0);
+    ivec2 texel = min(ivec2(fragTexCoord * vec2(size)), size - 1);
+
+    uint index = texelFetch(indexTexture, texel, 0).r;
+    uint bgra = palette.entries[index >> 2][index & 3u];
+
+    outColor = unpackUnorm4x8(bgra).zyxw;
+}
@@ -0,0 +1,35 @@
+# spv_to_constexpr.py
+#
+# Embeds a compiled SPIR-V module in a C++ header as a constexpr array.
+#
+#   python spv_to_constexpr.py <input.spv> <output.h> <arrayName>
+
+import struct
+import sys
+
+
+def main():
+    if len(sys.argv) != 4:
+        sys.exit("usage: spv_to_constexpr.py <input.spv> <output.h> <arrayName>")
+
+    source, header, name = sys.argv[1:]
+
+    with open(source, "rb") as f:
+        code = f.read()
+
+    if len(code) % 4 != 0:
+        sys.exit(f"{source}: size is not a multiple of 4 bytes")
+
+    words = struct.unpack(f"<{len(code) // 4}I", code)
+    lines = [", ".join(f"0x{w:08x}" for w in words[i:i + 8]) for i in range(0, len(words), 8)]
+
+    with open(header, "w", newline="\r\n") as f:
+        f.write(f"// {header.replace(chr(92), '/').split('/')[-1]} - generated from {source}, do not edit\n\n")
+        f.write("#pragma once\n\n#include <cstdint>\n\n")
+        f.write(f"inline constexpr uint32_t {name}[] = {{\n")
+        f.write(",\n".join(f"\t{line}" for line in lines))
+        f.write("\n};\n")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,317 @@
+// bench.cpp
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <windows.h>
+
+#include "bench.h"
+#include "bitmap.h"
+#include "config.h"
+#include "delta.h"
+#include "game.h"
+#include "gjd.h"
+#include "lzss.h"
+#include "vdx.h"
+#include "window.h"
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	// One benchmark: a latency sample per call, plus the work those calls did
+	struct Series
+	{
+		std::string name;
+		std::vector<double> samples;	// Milliseconds
+		uint64_t bytes = 0;
+		uint64_t frames = 0;
+
+		template <typename F>
+		void measure(uint64_t callBytes, uint64_t callFrames, F&& call)
+		{
+			const auto start = Clock::now();
+			call();
+			samples.push_back(std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+			bytes += callBytes;
+			frames += callFrames;
+		}
+	};
+
+	// Nearest-rank percentile of sorted samples
+	double percentile(const std::vector<double>& sorted, double p)
+	{
+		if (sorted.empty())
+			return 0.0;
+		const size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * sorted.size()));
+		return sorted[std::clamp<size_t>(rank, 1, sorted.size()) - 1];
+	}
+
+	nlohmann::json summarize(const Series& series)
+	{
+		std::vector<double> sorted = series.samples;
+		std::sort(sorted.begin(), sorted.end());
+
+		double totalMs = 0.0;
+		for (double sample : sorted)
+			totalMs += sample;
+		const double seconds = totalMs / 1000.0;
+
+		return {
+			{ "name", series.name },
+			{ "samples", sorted.size() },
+			{ "bytes", series.bytes },
+			{ "frames", series.frames },
+			{ "totalMs", totalMs },
+			{ "mbPerSecond", seconds > 0.0 ? series.bytes / (1024.0 * 1024.0) / seconds : 0.0 },
+			{ "framesPerSecond", seconds > 0.0 ? series.frames / seconds : 0.0 },
+			{ "minMs", sorted.empty() ? 0.0 : sorted.front() },
+			{ "p50Ms", percentile(sorted, 50.0) },
+			{ "p99Ms", percentile(sorted, 99.0) },
+			{ "maxMs", sorted.empty() ? 0.0 : sorted.back() }
+		};
+	}
+
+	//
+	// Codec benchmarks for one clip. Frame chunks are decompressed once, and
+	// the decoders run on those payloads in clip order.
+	//
+	void benchClip(const VDXFile& vdxFile, std::vector<Series>& codecs, uint64_t& sink)
+	{
+		enum { Decompress, CompressFast, CompressOptimal, BitmapRGB, BitmapIndices, DeltaRGB, DeltaIndices, ParseChunks };
+
+		std::vector<std::vector<uint8_t>> payloads;
+		std::vector<uint8_t> scratch(maxDecompressedSize(0x25));
+		uint64_t rawBytes = 0;
+
+		for (const VDXChunk& chunk : vdxFile.chunks)
+		{
+			rawBytes += chunk.raw.size();
+
+			if (chunk.chunkType != 0x20 && chunk.chunkType != 0x25)
+				continue;
+
+			if (chunk.lengthBits == 0)
+			{
+				payloads.emplace_back(chunk.raw.begin(), chunk.raw.end());
+				continue;
+			}
+
+			size_t size = 0;
+			codecs[Decompress].measure(0, 1, [&] {
+				size = lzssDecompress(chunk.raw, chunk.lengthMask, chunk.lengthBits,
+					std::span<uint8_t>(scratch.data(), maxDecompressedSize(chunk.chunkType)));
+				});
+			codecs[Decompress].bytes += size;
+			payloads.emplace_back(scratch.begin(), scratch.begin() + size);
+
+			// Optimal parsing is slow, so only the first frame of each clip is timed with it
+			const std::vector<uint8_t>& payload = payloads.back();
+			codecs[CompressFast].measure(size, 1, [&] { sink += lzssCompress(payload, chunk.lengthMask, chunk.lengthBits, LZSSLevel::Fast).size(); });
+			if (payloads.size() == 1)
+				codecs[CompressOptimal].measure(size, 1, [&] { sink += lzssCompress(payload, chunk.lengthMask, chunk.lengthBits, LZSSLevel::Optimal).size(); });
+		}
+
+		std::vector<RGBColor> palette;
+		std::vector<uint8_t> rgb;
+		IndexedFrame frame;
+		size_t frameIndex = 0;
+
+		for (const VDXChunk& chunk : vdxFile.chunks)
+		{
+			if (chunk.chunkType != 0x20 && chunk.chunkType != 0x25)
+				continue;
+
+			const std::vector<uint8_t>& payload = payloads[frameIndex++];
+			const uint64_t frameBytes = 640 * 320 * 3;
+
+			if (chunk.chunkType == 0x20)
+			{
+				codecs[BitmapRGB].measure(frameBytes, 1, [&] { std::tie(palette, rgb) = getBitmapData(payload); });
+				codecs[BitmapIndices].measure(640 * 320, 1, [&] { getBitmapIndices(payload, frame); });
+			}
+			else if (!rgb.empty())
+			{
+				codecs[DeltaRGB].measure(frameBytes, 1, [&] { std::tie(palette, rgb) = getDeltaBitmapData(payload, palette, rgb); });
+				codecs[DeltaIndices].measure(640 * 320, 1, [&] { applyDeltaIndices(payload, frame); });
+			}
+
+			sink += rgb.size() + frame.pixels.size();
+		}
+
+		// The whole file, as -p does it, on a copy so the archive's VDXFile stays unparsed
+		VDXFile copy = vdxFile;
+		codecs[ParseChunks].measure(rawBytes, countVDXFrames(vdxFile), [&] { parseVDXChunks(copy); });
+		sink += copy.chunks.size();
+	}
+
+	//
+	// Present frames of the archive's clips, in order, through one renderer
+	//
+	Series benchRenderer(const std::string& renderer, const std::vector<const VDXFile*>& clips, size_t frameBudget)
+	{
+		Series series{ "render." + renderer };
+
+		config["renderer"] = renderer;
+		state.gpuTileDecode = false;
+		initWindow();
+
+		bool open = true;
+
+		for (const VDXFile* vdxFile : clips)
+		{
+			if (!open || series.frames >= frameBudget)
+				break;
+
+			state.playback.start(*vdxFile, state.gpuTileDecode);
+			state.dirty.markAll();
+
+			for (bool more = true; more && series.frames < frameBudget;)
+			{
+				if (!(open = processEvents()))
+					break;
+
+				// Bytes: the palette-indexed pixels handed to the renderer
+				const uint64_t changed = state.dirty.palette ? 640 * 320 : state.dirty.tiles.count() * 16;
+				series.measure(changed, 1, [] { renderFrame(); });
+
+				// Wait for the decoder; only renderFrame is timed
+				while (!(more = state.playback.advance()) && !state.playback.finished())
+					std::this_thread::yield();
+
+				if (more)
+					state.dirty.merge(state.playback.current()->dirty);
+			}
+		}
+
+		state.playback.stop();
+		cleanupWindow();
+
+		// Only the Direct2D cleanup takes the window down with it
+		if (hwnd)
+		{
+			DestroyWindow(hwnd);
+			hwnd = nullptr;
+		}
+
+		// WM_DESTROY posts WM_QUIT, which would end the next pass at once
+		MSG msg;
+		while (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE)) {}
+
+		return series;
+	}
+}
+
+/*
+===============================================================================
+Function Name: runBenchmarks
+
+Description:
+	- Runs every benchmark over the VDX files of an RL/GJD pair, prints a
+	table and writes the results as JSON.
+
+Parameters:
+	- rlFilename: The 7th Guest RL file whose clips are benchmarked
+	- options: Renderer passes and the report path, see BenchOptions
+
+Return:
+	- int: 0 on success, 1 if the archive holds no VDX files or the report
+	could not be written
+
+Notes:
+	- Renderer samples include present, so they can be capped by vsync.
+	- The configured renderer is restored afterwards.
+===============================================================================
+*/
+int runBenchmarks(const std::string& rlFilename, const BenchOptions& options)
+{
+	GJDArchive archive = openGJDArchive(rlFilename);
+
+	std::vector<Series> codecs = {
+		{ "lzssDecompress" }, { "lzssCompress.fast" }, { "lzssCompress.optimal" },
+		{ "getBitmapData" }, { "getBitmapIndices" }, { "getDeltaBitmapData" }, { "applyDeltaIndices" },
+		{ "parseVDXChunks" }
+	};
+
+	std::vector<const VDXFile*> clips;
+	uint64_t sink = 0;
+
+	std::cout << "Benchmarking " << archive.entries.size() << " entries of " << rlFilename << "..." << std::endl;
+
+	for (const RLEntry& entry : archive.entries)
+	{
+		const VDXFile* vdxFile = archive.getVDX(vdxNameFor(entry));
+		if (!vdxFile || countVDXFrames(*vdxFile) == 0)
+			continue;
+
+		benchClip(*vdxFile, codecs, sink);
+		clips.push_back(vdxFile);
+	}
+
+	if (clips.empty())
+	{
+		std::cerr << "ERROR: " << rlFilename << " contains no VDX files." << std::endl;
+		return 1;
+	}
+
+	std::vector<Series> renders;
+	if (options.render)
+	{
+		const std::string configured = config["renderer"];
+		for (const char* renderer : { "Direct2D", "VULKAN" })
+			renders.push_back(benchRenderer(renderer, clips, options.renderFrames));
+		config["renderer"] = configured;
+	}
+
+	nlohmann::json report = {
+		{ "archive", std::filesystem::path(rlFilename).filename().string() },
+		{ "clips", clips.size() },
+		{ "threads", std::thread::hardware_concurrency() },
+		{ "checksum", sink },				// Sizes of everything decoded, so none of it is optimized away
+		{ "results", nlohmann::json::array() }
+	};
+
+	std::cout << "\n" << std::left << std::setw(24) << "Benchmark" << std::right << std::setw(10) << "Samples"
+		<< std::setw(12) << "MB/s" << std::setw(12) << "frames/s" << std::setw(10) << "p50 ms" << std::setw(10) << "p99 ms" << std::endl;
+	std::cout << std::fixed << std::setprecision(1);
+
+	for (const std::vector<Series>* group : { &codecs, &renders })
+	{
+		for (const Series& series : *group)
+		{
+			if (series.samples.empty())
+				continue;
+
+			const nlohmann::json result = summarize(series);
+			report["results"].push_back(result);
+
+			std::cout << std::left << std::setw(24) << series.name << std::right << std::setw(10) << series.samples.size()
+				<< std::setw(12) << result["mbPerSecond"].get<double>() << std::setw(12) << result["framesPerSecond"].get<double>()
+				<< std::setprecision(3) << std::setw(10) << result["p50Ms"].get<double>() << std::setw(10) << result["p99Ms"].get<double>()
+				<< std::setprecision(1) << std::endl;
+		}
+	}
+
+	std::cout << std::defaultfloat;
+
+	const std::string output = !options.output.empty() ? options.output
+		: std::filesystem::path(rlFilename).stem().string() + "_bench.json";
+
+	std::ofstream reportFile(output);
+	reportFile << std::setw(4) << report << std::endl;
+	if (!reportFile)
+	{
+		std::cerr << "ERROR: Failed to write " << output << std::endl;
+		return 1;
+	}
+
+	std::cout << "\nReport: " << output << std::endl;
+	return 0;
+}
\ No newline at end of file
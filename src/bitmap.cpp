@@ -13,8 +13,43 @@
 #include <numeric>
 #include <algorithm>
 #include <ranges>
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <emmintrin.h>
+#include <climits>
+#include <unordered_map>
 
 #include "bitmap.h"
+#include "threadpool.h"
+
+namespace
+{
+	// One byte of a tile's colour map (MSB = first pixel) -> 0xFF for every
+	// pixel that takes colour1, i.e. a blend mask for two rows of the tile
+	constexpr auto MaskExpansion = [] {
+		std::array<uint64_t, 256> masks{};
+		for (uint32_t bits = 0; bits < 256; ++bits)
+			for (int pixel = 0; pixel < 8; ++pixel)
+				if (bits & (0x80 >> pixel)) masks[bits] |= 0xFFull << (pixel * 8);
+		return masks;
+		}();
+
+	//
+	// The 16 palette indices of one 4-byte tile record, row-major. SSE2 is
+	// part of x64, so this needs no CPU check.
+	//
+	inline __m128i expandTile(const uint8_t* tile)
+	{
+		// High byte of the map covers rows 0-1, low byte rows 2-3
+		const __m128i mask = _mm_set_epi64x(static_cast<long long>(MaskExpansion[tile[2]]),
+			static_cast<long long>(MaskExpansion[tile[3]]));
+		const __m128i colour1 = _mm_set1_epi8(static_cast<char>(tile[0]));
+		const __m128i colour0 = _mm_set1_epi8(static_cast<char>(tile[1]));
+
+		return _mm_or_si128(_mm_and_si128(mask, colour1), _mm_andnot_si128(mask, colour0));
+	}
+}
 
 /*
 ===============================================================================
@@ -30,7 +65,18 @@ Return:
 	- std::vector<uint8_t>: 8-bit RGB raw bitmap data structure
 ===============================================================================
 */
-std::tuple<std::vector<RGBColor>, std::vector<uint8_t>> getBitmapData(const std::vector<uint8_t>& chunkData)
+std::tuple<std::vector<RGBColor>, std::vector<uint8_t>> getBitmapData(std::span<const uint8_t> chunkData)
+{
+	IndexedFrame frame;
+	getBitmapIndices(chunkData, frame);
+
+	return { std::vector<RGBColor>(frame.palette.begin(), frame.palette.end()), expandToRGB(frame) };
+}
+
+//
+// Size frame and read the palette of a 0x20 chunk; returns the start of its tile stream
+//
+static const uint8_t* readBitmapHeader(std::span<const uint8_t> chunkData, IndexedFrame& frame)
 {
 	auto [numXTiles, numYTiles, colourDepth] = std::tuple{
 		readLittleEndian<uint16_t>(chunkData.data()),
@@ -38,42 +84,383 @@ std::tuple<std::vector<RGBColor>, std::vector<uint8_t>> getBitmapData(const std:
 		readLittleEndian<uint16_t>(chunkData.data() + 4)
 	};
 
-	const int width = numXTiles * 4, height = numYTiles * 4;
-	std::vector<uint8_t> outputImageData(width * height * 3);
+	frame.resize(numXTiles * 4, numYTiles * 4);
 
 	const uint8_t* paletteData = chunkData.data() + 6;
-	std::vector<RGBColor> palette(256);
 	for (int i = 0; i < 256; ++i) {
-		palette[i] = { paletteData[i * 3], paletteData[i * 3 + 1], paletteData[i * 3 + 2] };
+		frame.palette[i] = { paletteData[i * 3], paletteData[i * 3 + 1], paletteData[i * 3 + 2] };
 	}
 
-	const uint8_t* imageData = paletteData + (1 << colourDepth) * 3;
+	return paletteData + (1 << colourDepth) * 3;
+}
 
-	for (int tileY = 0; tileY < numYTiles; ++tileY) {
-		for (int tileX = 0; tileX < numXTiles; ++tileX) {
-			uint8_t colour1 = *imageData++, colour0 = *imageData++;
-			uint16_t colourMap = readLittleEndian<uint16_t>(imageData);
-			imageData += 2;
-
-			std::array<uint8_t, 16> colors;
-			for (int i = 15; i >= 0; --i) {
-				colors[i] = (colourMap & 1) ? colour1 : colour0;
-				colourMap >>= 1;
-			}
+/*
+===============================================================================
+Function Name: decodeTileRows
+
+Description:
+	- Expands tile rows [firstRow, lastRow) of a tile stream covering the
+	whole frame into frame.pixels. Four tiles are expanded side by side and
+	transposed, so each of their pixel rows is one 16-byte store.
+
+Parameters:
+	- imageData: Start of the tile stream (4 bytes per tile)
+	- frame: Sized for the stream; receives the pixels
+	- firstRow, lastRow: Tile rows to decode. Rows are independent, so
+	disjoint ranges can be decoded on different threads.
+===============================================================================
+*/
+static void decodeTileRows(const uint8_t* imageData, IndexedFrame& frame, int firstRow, int lastRow)
+{
+	const int width = frame.width;
+	const int numXTiles = frame.width / 4;
+
+	for (int tileY = firstRow; tileY < lastRow; ++tileY) {
+		const uint8_t* tiles = imageData + static_cast<size_t>(tileY) * numXTiles * 4;
+		uint8_t* rows = frame.pixels.data() + static_cast<size_t>(tileY) * 4 * width;
+		int tileX = 0;
+
+		for (; tileX + 4 <= numXTiles; tileX += 4, tiles += 16) {
+			const __m128i a = expandTile(tiles), b = expandTile(tiles + 4);
+			const __m128i c = expandTile(tiles + 8), d = expandTile(tiles + 12);
+
+			// 4x4 transpose of 32-bit tile rows: row y of all four tiles
+			const __m128i ab01 = _mm_unpacklo_epi32(a, b), cd01 = _mm_unpacklo_epi32(c, d);
+			const __m128i ab23 = _mm_unpackhi_epi32(a, b), cd23 = _mm_unpackhi_epi32(c, d);
+
+			uint8_t* out = rows + tileX * 4;
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_unpacklo_epi64(ab01, cd01));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + width), _mm_unpackhi_epi64(ab01, cd01));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + width * 2), _mm_unpacklo_epi64(ab23, cd23));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + width * 3), _mm_unpackhi_epi64(ab23, cd23));
+		}
+
+		// Frames whose width is not a multiple of 16 pixels
+		for (; tileX < numXTiles; ++tileX, tiles += 4) {
+			alignas(16) uint8_t pixels[16];
+			_mm_store_si128(reinterpret_cast<__m128i*>(pixels), expandTile(tiles));
 
 			for (int y = 0; y < 4; ++y) {
-				for (int x = 0; x < 4; ++x) {
-					int pixelIndex = ((tileY * 4 + y) * width + (tileX * 4 + x)) * 3;
-					auto& pixelColor = palette[colors[x + y * 4]];
-					outputImageData[pixelIndex] = pixelColor.r;
-					outputImageData[pixelIndex + 1] = pixelColor.g;
-					outputImageData[pixelIndex + 2] = pixelColor.b;
+				std::memcpy(rows + y * width + tileX * 4, pixels + y * 4, 4);
+			}
+		}
+	}
+}
+
+//
+// Expand a tile stream covering the whole frame into frame.pixels
+//
+static void decodeTiles(const uint8_t* imageData, IndexedFrame& frame)
+{
+	decodeTileRows(imageData, frame, 0, frame.height / 4);
+}
+
+/*
+===============================================================================
+Function Name: getBitmapIndices
+
+Description:
+	- Decodes a 0x20 chunk into an 8-bit palette-indexed frame. Same tile
+	format as getBitmapData, but each pixel is stored as its palette index.
+
+Parameters:
+	- chunkData: Decompressed chunk data
+	- frame: Receives the palette and pixel indices; resized to the chunk's
+	dimensions (its storage is reused when the size does not change)
+===============================================================================
+*/
+void getBitmapIndices(std::span<const uint8_t> chunkData, IndexedFrame& frame)
+{
+	decodeTiles(readBitmapHeader(chunkData, frame), frame);
+	frame.tiles.clear();
+}
+
+/*
+===============================================================================
+Function Name: getBitmapIndices (parallel)
+
+Description:
+	- As getBitmapIndices, with the tile rows split into bands that are
+	decoded by the calling thread and by workers of pool at the same time.
+
+Parameters:
+	- chunkData: Decompressed chunk data
+	- frame: As for getBitmapIndices
+	- pool: Pool to borrow workers from
+
+Notes:
+	- The caller keeps taking bands itself rather than blocking on the pool,
+	so it finishes even if every worker is busy (or it is a pool worker).
+	Workers that start after the last band has been taken do nothing.
+	- A single 640x320 frame decodes in microseconds, so this only pays for
+	itself when the pool's workers are already awake.
+===============================================================================
+*/
+void getBitmapIndices(std::span<const uint8_t> chunkData, IndexedFrame& frame, ThreadPool& pool)
+{
+	constexpr int bandRows = 8;
+
+	struct Bands
+	{
+		std::atomic<int> next{ 0 };
+		std::atomic<int> done{ 0 };
+	};
+
+	const uint8_t* imageData = readBitmapHeader(chunkData, frame);
+	frame.tiles.clear();
+
+	const int numYTiles = frame.height / 4;
+	const int bandCount = (numYTiles + bandRows - 1) / bandRows;
+	auto bands = std::make_shared<Bands>();
+
+	auto decodeBands = [bands, bandCount, numYTiles, imageData, &frame] {
+		for (int band; (band = bands->next.fetch_add(1, std::memory_order_relaxed)) < bandCount; ) {
+			decodeTileRows(imageData, frame, band * bandRows, std::min(numYTiles, (band + 1) * bandRows));
+
+			if (bands->done.fetch_add(1, std::memory_order_acq_rel) + 1 == bandCount)
+				bands->done.notify_all();
+		}
+		};
+
+	const size_t helpers = bandCount > 1 ? std::min<size_t>(pool.size(), static_cast<size_t>(bandCount)) - 1 : 0;
+	for (size_t i = 0; i < helpers; ++i)
+		pool.submit(decodeBands);
+
+	decodeBands();
+
+	for (int done; (done = bands->done.load(std::memory_order_acquire)) != bandCount; )
+		bands->done.wait(done, std::memory_order_acquire);
+}
+
+/*
+===============================================================================
+Function Name: getBitmapTiles
+
+Description:
+	- Reads the palette of a 0x20 chunk and keeps its tile stream undecoded in
+	frame.tiles, for consumers that expand tiles themselves (e.g. the Vulkan
+	compute path). expandBitmapTiles turns it into pixels when needed.
+
+Parameters:
+	- chunkData: Decompressed chunk data
+	- frame: Receives the palette and tile stream; resized to the chunk's
+	dimensions, but its pixels are left untouched
+===============================================================================
+*/
+void getBitmapTiles(std::span<const uint8_t> chunkData, IndexedFrame& frame)
+{
+	const uint8_t* imageData = readBitmapHeader(chunkData, frame);
+	frame.tiles.assign(imageData, imageData + (frame.pixels.size() / 16) * 4);
+}
+
+//
+// Decode frame.tiles into frame.pixels and drop the tile stream
+//
+void expandBitmapTiles(IndexedFrame& frame)
+{
+	decodeTiles(frame.tiles.data(), frame);
+	frame.tiles.clear();
+}
+
+//
+// Size the pixel buffer for width x height, keeping its capacity
+//
+void IndexedFrame::resize(int newWidth, int newHeight)
+{
+	width = newWidth;
+	height = newHeight;
+	pixels.resize(static_cast<size_t>(width) * height);
+}
+
+//
+// Expand an indexed frame to 8-bit RGB, e.g. for PNG export
+//
+std::vector<uint8_t> expandToRGB(const IndexedFrame& frame)
+{
+	std::vector<uint8_t> rgb(frame.pixels.size() * 3);
+
+	for (size_t i = 0; i < frame.pixels.size(); ++i) {
+		const RGBColor& color = frame.palette[frame.pixels[i]];
+		rgb[i * 3] = color.r;
+		rgb[i * 3 + 1] = color.g;
+		rgb[i * 3 + 2] = color.b;
+	}
+
+	return rgb;
+}
+
+/*
+===============================================================================
+Function Name: DirtyTiles::rects
+
+Description:
+	- Turns the dirty tile set into pixel rectangles for partial uploads.
+	Runs of dirty tiles on a tile row become one rectangle, and identical
+	runs on consecutive rows are merged vertically.
+
+Parameters:
+	- maxRects: Past this many rectangles a single full-frame rectangle is
+	returned instead, since per-region overhead would dominate
+
+Return:
+	- std::vector<PixelRect>: Empty if nothing changed; the whole frame if
+	the palette changed
+===============================================================================
+*/
+std::vector<PixelRect> DirtyTiles::rects(size_t maxRects) const
+{
+	const PixelRect full{ 0, 0, columns * 4, rows * 4 };
+
+	if (palette) return { full };
+	if (tiles.none()) return {};
+
+	std::vector<PixelRect> result;
+	std::vector<size_t> open, next;		// Rectangles that reach the previous/current row
+
+	for (int tileY = 0; tileY < rows; ++tileY) {
+		next.clear();
+
+		for (int tileX = 0; tileX < columns; ) {
+			if (!test(tileX, tileY)) { ++tileX; continue; }
+
+			const int start = tileX;
+			while (tileX < columns && test(tileX, tileY)) ++tileX;
+
+			const PixelRect run{ start * 4, tileY * 4, (tileX - start) * 4, 4 };
+			auto it = std::ranges::find_if(open, [&](size_t i) {
+				return result[i].x == run.x && result[i].width == run.width; });
+
+			if (it != open.end()) {
+				result[*it].height += 4;
+				next.push_back(*it);
+			}
+			else {
+				result.push_back(run);
+				next.push_back(result.size() - 1);
+			}
+
+			if (result.size() > maxRects) return { full };
+		}
+
+		std::swap(open, next);
+	}
+
+	return result;
+}
+
+//
+// Colour -> palette index for packBitmapData and packDeltaBitmapData
+//
+static int colourDistance(const RGBColor& a, const RGBColor& b)
+{
+	const int dr = a.r - b.r, dg = a.g - b.g, db = a.b - b.b;
+	return dr * dr + dg * dg + db * db;
+}
+
+PaletteMatcher::PaletteMatcher(std::span<const RGBColor> palette) : palette(palette), cube(size_t(1) << 18, NoMatch)
+{
+	exact.reserve(palette.size());
+	for (size_t i = 0; i < palette.size(); ++i)
+		exact.try_emplace(key(palette[i]), static_cast<uint8_t>(i));
+}
+
+uint8_t PaletteMatcher::match(const RGBColor& color)
+{
+	if (auto it = exact.find(key(color)); it != exact.end())
+		return it->second;
+
+	uint16_t& cell = cube[((color.r >> 2) << 12) | ((color.g >> 2) << 6) | (color.b >> 2)];
+	if (cell == NoMatch)
+		cell = nearest({ static_cast<uint8_t>((color.r & 0xFC) | 2), static_cast<uint8_t>((color.g & 0xFC) | 2), static_cast<uint8_t>((color.b & 0xFC) | 2) });
+
+	return static_cast<uint8_t>(cell);
+}
+
+uint16_t PaletteMatcher::nearest(const RGBColor& color) const
+{
+	uint16_t best = 0;
+	int bestDistance = INT_MAX;
+
+	for (size_t i = 0; i < palette.size() && bestDistance > 0; ++i) {
+		if (const int distance = colourDistance(palette[i], color); distance < bestDistance) {
+			bestDistance = distance;
+			best = static_cast<uint16_t>(i);
+		}
+	}
+
+	return best;
+}
+
+//
+// Pick the two palette colours that best reproduce a 4x4 block and the
+// map between them: { colour1, colour0, map low byte, map high byte }
+//
+std::array<uint8_t, 4> fitTile(const std::array<RGBColor, 16>& pixels, PaletteMatcher& matcher)
+{
+	std::array<uint8_t, 16> indices;
+	for (int i = 0; i < 16; ++i)
+		indices[i] = matcher.match(pixels[i]);
+
+	uint8_t colour0 = indices[0], colour1 = indices[0];
+	bool twoOrFewer = true;
+
+	for (uint8_t index : indices) {
+		if (index == colour0 || index == colour1) continue;
+		if (colour1 == colour0) colour1 = index;
+		else { twoOrFewer = false; break; }
+	}
+
+	// More than two colours: split the block in two with 2-means,
+	// starting from its two most different pixels
+	if (!twoOrFewer) {
+		int seed0 = 0, seed1 = 0, widest = -1;
+		for (int i = 0; i < 16; ++i)
+			for (int j = i + 1; j < 16; ++j)
+				if (const int distance = colourDistance(pixels[i], pixels[j]); distance > widest) {
+					widest = distance;
+					seed0 = i;
+					seed1 = j;
 				}
+
+		RGBColor centre0 = pixels[seed0], centre1 = pixels[seed1];
+		uint16_t groups = 0;
+
+		for (int iteration = 0; iteration < 4; ++iteration) {
+			uint16_t assigned = 0;
+			int sum0[3]{}, sum1[3]{}, count1 = 0;
+
+			for (int i = 0; i < 16; ++i) {
+				const bool second = colourDistance(pixels[i], centre1) < colourDistance(pixels[i], centre0);
+				int* sum = second ? sum1 : sum0;
+				sum[0] += pixels[i].r;
+				sum[1] += pixels[i].g;
+				sum[2] += pixels[i].b;
+				if (second) { assigned |= 1 << i; ++count1; }
 			}
+
+			if (iteration > 0 && assigned == groups) break;
+			groups = assigned;
+
+			const int count0 = 16 - count1;
+			if (count0 > 0) centre0 = { uint8_t(sum0[0] / count0), uint8_t(sum0[1] / count0), uint8_t(sum0[2] / count0) };
+			if (count1 > 0) centre1 = { uint8_t(sum1[0] / count1), uint8_t(sum1[1] / count1), uint8_t(sum1[2] / count1) };
+		}
+
+		colour0 = matcher.match(centre0);
+		colour1 = matcher.match(centre1);
+	}
+
+	// Bit 15 is the top-left pixel; set bits take colour1
+	uint16_t colourMap = 0;
+	if (colour1 != colour0) {
+		for (int i = 0; i < 16; ++i) {
+			const bool first = indices[i] == colour1 ||
+				(indices[i] != colour0 && colourDistance(pixels[i], matcher[colour1]) < colourDistance(pixels[i], matcher[colour0]));
+			if (first) colourMap |= 0x8000 >> i;
 		}
 	}
 
-	return { palette, outputImageData };
+	return { colour1, colour0, static_cast<uint8_t>(colourMap & 0xFF), static_cast<uint8_t>(colourMap >> 8) };
 }
 
 /*
@@ -86,38 +473,50 @@ Description:
 
 	Parameters:
 	- rawImageData: 8-bit RGB raw bitmap data structure
-	- palette: 8-bit RGB palette data structure
+	- palette: 8-bit RGB palette data structure (padded with black to 256)
 	- width: width of the image
 	- height: height of the image
 
 	Return:
 	- std::vector<uint8_t>: 7th Guest 4x4, 2-colour, bitmap chunk data structure
+
+	Notes:
+	- Any RGB input is accepted. Colours missing from the palette go to the
+	nearest entry, and blocks with more than two colours are fitted with
+	the two palette colours that reproduce them best.
 	===============================================================================
 */
 std::vector<uint8_t> packBitmapData(const std::vector<uint8_t>& rawImageData, const std::vector<RGBColor>& palette, int width, int height)
 {
+	if (rawImageData.size() < static_cast<size_t>(width) * height * 3)
+		throw std::runtime_error("packBitmapData: image data is smaller than " + std::to_string(width) + "x" + std::to_string(height));
+
+	if (palette.empty() || palette.size() > 256)
+		throw std::runtime_error("packBitmapData: palette must have 1 to 256 colours");
+
 	const auto [numXTiles, numYTiles, colourDepth] = std::tuple{ width / 4, height / 4, uint16_t{8} };
 	std::vector<uint8_t> chunkData{ static_cast<uint8_t>(numXTiles & 0xFF), static_cast<uint8_t>((numXTiles >> 8) & 0xFF),
 									static_cast<uint8_t>(numYTiles & 0xFF), static_cast<uint8_t>((numYTiles >> 8) & 0xFF),
 									static_cast<uint8_t>(colourDepth), static_cast<uint8_t>(0) };
+	chunkData.reserve(chunkData.size() + 256 * 3 + static_cast<size_t>(numXTiles) * numYTiles * 4);
 
 	for (const auto& color : palette) chunkData.insert(chunkData.end(), { color.r, color.g, color.b });
+	chunkData.resize(chunkData.size() + (256 - palette.size()) * 3, 0);
+
+	PaletteMatcher matcher(palette);
 
 	for (int tileY = 0; tileY < numYTiles; ++tileY) {
 		for (int tileX = 0; tileX < numXTiles; ++tileX) {
-			std::array<uint8_t, 16> colors;
-			auto getPixelIndex = [&](int x, int y) { return ((tileY * 4 + y) * width + (tileX * 4 + x)) * 3; };
-
-			for (int y = 0; y < 4; ++y)
-				for (int x = 0; x < 4; ++x)
-					colors[x + y * 4] = std::distance(palette.begin(), std::ranges::find(palette, RGBColor{
-						rawImageData[getPixelIndex(x, y)], rawImageData[getPixelIndex(x, y) + 1], rawImageData[getPixelIndex(x, y) + 2] }));
+			std::array<RGBColor, 16> pixels;
 
-			uint8_t colour0 = colors[0], colour1 = colors[1];
-			uint16_t colourMap = std::accumulate(colors.rbegin(), colors.rend(), uint16_t(0), [&](auto acc, auto c) {
-				return (acc << 1) | (c == colour1); });
+			for (int y = 0; y < 4; ++y) {
+				const uint8_t* row = rawImageData.data() + ((tileY * 4 + y) * static_cast<size_t>(width) + tileX * 4) * 3;
+				for (int x = 0; x < 4; ++x, row += 3)
+					pixels[x + y * 4] = { row[0], row[1], row[2] };
+			}
 
-			chunkData.insert(chunkData.end(), { colour1, colour0, static_cast<uint8_t>(colourMap & 0xFF), static_cast<uint8_t>((colourMap >> 8) & 0xFF) });
+			const auto tile = fitTile(pixels, matcher);
+			chunkData.insert(chunkData.end(), tile.begin(), tile.end());
 		}
 	}
 	return chunkData;
@@ -0,0 +1,109 @@
+// cache.cpp
+
+#include "cache.h"
+
+//
+// Limit the memory held by cached clips; evicts immediately if already over
+//
+void ClipCache::setBudget(size_t newBudget)
+{
+	std::lock_guard lock(mutex);
+	budget = newBudget;
+	evict();
+}
+
+/*
+===============================================================================
+Function Name: ClipCache::find
+
+Description:
+	- Looks up a clip and, on a hit, moves it to the front of the LRU list.
+	Counts towards the hit/miss statistics.
+
+Parameters:
+	- key: Room and view name.
+
+Return:
+	- Copy of the cached clip, ready for FramePipeline::start(), or nullopt.
+
+Notes:
+	- The entry stays cached, so the copy can be consumed by the pipeline
+	while repeat visits still hit.
+===============================================================================
+*/
+std::optional<WarmClip> ClipCache::find(const Key& key)
+{
+	std::lock_guard lock(mutex);
+
+	auto it = index.find(key);
+	if (it == index.end())
+	{
+		++misses;
+		return std::nullopt;
+	}
+
+	++hits;
+	lru.splice(lru.begin(), lru, it->second);
+
+	return it->second->clip;
+}
+
+//
+// Mark a clip as recently used without counting a lookup; false if not cached
+//
+bool ClipCache::touch(const Key& key)
+{
+	std::lock_guard lock(mutex);
+
+	auto it = index.find(key);
+	if (it == index.end())
+		return false;
+
+	lru.splice(lru.begin(), lru, it->second);
+
+	return true;
+}
+
+//
+// Add a clip (replacing any previous one for the key) and enforce the budget
+//
+void ClipCache::insert(Key key, WarmClip clip)
+{
+	std::lock_guard lock(mutex);
+
+	if (auto it = index.find(key); it != index.end())
+	{
+		bytes -= it->second->bytes;
+		lru.erase(it->second);
+		index.erase(it);
+	}
+
+	const size_t size = clip.bytes();
+	lru.push_front({ key, std::move(clip), size });
+	index.emplace(std::move(key), lru.begin());
+	bytes += size;
+
+	evict();
+}
+
+//
+// Snapshot of the counters
+//
+ClipCache::Stats ClipCache::stats() const
+{
+	std::lock_guard lock(mutex);
+	return { hits, misses, lru.size(), bytes, budget };
+}
+
+//
+// Drop least recently used clips until within budget; caller holds the mutex
+//
+void ClipCache::evict()
+{
+	while (bytes > budget && !lru.empty())
+	{
+		bytes -= lru.back().bytes;
+		index.erase(lru.back().key);
+		lru.pop_back();
+	}
+}
\ No newline at end of file
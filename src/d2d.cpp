@@ -9,11 +9,14 @@
 #include "config.h"
 #include "window.h"
 #include "game.h"
+#include "pixel.h"
+#include "profiler.h"
 
 // Globals
 static ID2D1Factory* factory = nullptr;
 ID2D1HwndRenderTarget* renderTarget = nullptr;
 static ID2D1Bitmap* bitmap = nullptr;
+static ID2D1SolidColorBrush* overlayBrush = nullptr;
 
 // Helper function to create or resize the bitmap
 void ensureBitmapSize(UINT width, UINT height) {
@@ -29,6 +32,7 @@ void ensureBitmapSize(UINT width, UINT height) {
 		D2D1::BitmapProperties(D2D1::PixelFormat(DXGI_FORMAT_B8G8R8A8_UNORM, D2D1_ALPHA_MODE_IGNORE)),
 		&bitmap
 	);
+	state.dirty.markAll();	// New bitmap has no contents yet
 }
 
 // Initialize Direct2D resources
@@ -58,6 +62,27 @@ void initializeD2D() {
 	ensureBitmapSize(state.ui.width, state.ui.height);
 }
 
+//
+// Profiler overlay (devMode), drawn over the frame between BeginDraw and EndDraw
+//
+static void drawOverlayD2D() {
+	const std::vector<OverlayRect> rects = buildProfilerOverlay();
+	if (rects.empty()) {
+		return;
+	}
+
+	if (!overlayBrush && FAILED(renderTarget->CreateSolidColorBrush(D2D1::ColorF(D2D1::ColorF::White), &overlayBrush))) {
+		return;
+	}
+
+	for (const OverlayRect& rect : rects) {
+		overlayBrush->SetColor(D2D1::ColorF(rect.color));
+		renderTarget->FillRectangle(D2D1::RectF(
+			static_cast<float>(rect.x), static_cast<float>(rect.y),
+			static_cast<float>(rect.x + rect.width), static_cast<float>(rect.y + rect.height)), overlayBrush);
+	}
+}
+
 //
 // Render a frame using Direct2D
 //
@@ -74,21 +99,35 @@ void renderFrameD2D() {
 			D2D1::BitmapProperties(D2D1::PixelFormat(DXGI_FORMAT_B8G8R8A8_UNORM, D2D1_ALPHA_MODE_IGNORE)),
 			&bitmap
 		);
+		state.dirty.markAll();
 	}
 
-	// Convert RGB to BGRA
-	std::span<const uint8_t> pixelData = state.currentVDX->chunks[state.currentFrameIndex].data;
-	std::vector<uint8_t> bgraData(MIN_CLIENT_WIDTH * MIN_CLIENT_HEIGHT * 4);
-	for (size_t i = 0, j = 0; i < pixelData.size(); i += 3, j += 4) {
-		bgraData[j] = pixelData[i + 2];     // Blue
-		bgraData[j + 1] = pixelData[i + 1]; // Green
-		bgraData[j + 2] = pixelData[i];     // Red
-		bgraData[j + 3] = 255;              // Alpha
+	const IndexedFrame* frame = currentFrame();
+	if (!frame) {
+		return;
 	}
 
-	HRESULT hr = bitmap->CopyFromMemory(nullptr, bgraData.data(), MIN_CLIENT_WIDTH * 4);
-	if (FAILED(hr)) {
-		throw std::runtime_error("Failed to copy frame data into bitmap");
+	// Expand and upload only the regions that changed since the last upload
+	const std::vector<PixelRect> rects = state.dirty.rects();
+	if (!rects.empty()) {
+		std::span<uint32_t> bgraFrame = bgraScratch(MIN_CLIENT_WIDTH * MIN_CLIENT_HEIGHT);
+		{
+			ScopedTimer timer(ProfileScope::Convert);
+			expandToBGRA(*frame, bgraFrame, rects);
+		}
+
+		ScopedTimer timer(ProfileScope::Upload);
+		for (const PixelRect& rect : rects) {
+			const D2D1_RECT_U destRect = D2D1::RectU(rect.x, rect.y, rect.x + rect.width, rect.y + rect.height);
+			const uint32_t* source = bgraFrame.data() + rect.y * MIN_CLIENT_WIDTH + rect.x;
+
+			HRESULT hr = bitmap->CopyFromMemory(&destRect, source, MIN_CLIENT_WIDTH * 4);
+			if (FAILED(hr)) {
+				throw std::runtime_error("Failed to copy frame data into bitmap");
+			}
+		}
+
+		state.dirty.clear();
 	}
 
 	renderTarget->BeginDraw();
@@ -123,17 +162,28 @@ void renderFrameD2D() {
 		sourceRect
 	);
 
-	hr = renderTarget->EndDraw();
+	drawOverlayD2D();
+
+	ScopedTimer timer(ProfileScope::Present);
+	HRESULT hr = renderTarget->EndDraw();
 	if (FAILED(hr)) {
 		throw std::runtime_error("Failed to draw frame");
 	}
+	timer.stop();
+
+	profiler.endFrame();
 }
 
 // Cleanup Direct2D resources
 void cleanupD2D() {
+	if (overlayBrush) overlayBrush->Release();
 	if (bitmap) bitmap->Release();
 	if (renderTarget) renderTarget->Release();
 	if (factory) factory->Release();
+	overlayBrush = nullptr;
+	bitmap = nullptr;
+	renderTarget = nullptr;
+	factory = nullptr;
 	if (hwnd) DestroyWindow(hwnd);
 	hwnd = nullptr;
 }
\ No newline at end of file
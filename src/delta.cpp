@@ -3,11 +3,89 @@
 #include <vector>
 #include <tuple>
 #include <cstdint>
+#include <cstring>
 #include <algorithm>
+#include <stdexcept>
+#include <string>
 
 #include "bitmap.h"
 #include "delta.h"
 
+//
+// Opcode tables, built once at compile time
+//
+namespace
+{
+	// MapField as one 16-bit tile mask per 0x00-0x5F opcode; bit 15 is the top-left pixel
+	constexpr auto MapValues = [] {
+		std::array<uint16_t, 96> values{};
+		for (size_t i = 0; i < values.size(); ++i)
+			values[i] = static_cast<uint16_t>(MapField[i * 2] | (MapField[i * 2 + 1] << 8));
+		return values;
+		}();
+
+	// 4-bit row of a tile mask (MSB = leftmost pixel) -> byte mask for a little-endian 4-pixel store
+	constexpr auto RowMasks = [] {
+		std::array<uint32_t, 16> masks{};
+		for (uint32_t bits = 0; bits < 16; ++bits)
+			for (int x = 0; x < 4; ++x)
+				if (bits & (8 >> x)) masks[bits] |= 0xFFu << (x * 8);
+		return masks;
+		}();
+
+	// 0x00-0x5F opcode whose MapValues entry is mapValue, or -1
+	constexpr int mapOpcode(uint16_t mapValue)
+	{
+		for (size_t i = 0; i < MapValues.size(); ++i)
+			if (MapValues[i] == mapValue) return static_cast<int>(i);
+		return -1;
+	}
+
+	constexpr uint32_t splat(uint8_t index) { return index * 0x01010101u; }
+
+	void storeRow(uint8_t* dst, uint32_t row) { std::memcpy(dst, &row, sizeof(row)); }
+
+	void storeRGB(uint8_t* dst, const RGBColor& color)
+	{
+		dst[0] = color.r;
+		dst[1] = color.g;
+		dst[2] = color.b;
+	}
+}
+
+//
+// Apply the local palette of a 0x25 chunk; returns the size of the palette
+// section, i.e. where the opcodes start (minus the 2-byte size field)
+//
+static uint16_t applyDeltaPalette(std::span<const uint8_t> buffer, std::span<RGBColor> palette)
+{
+	const uint16_t localPaletteSize = (buffer[0] | (buffer[1] << 8));
+	size_t paletteColorIndex = 0;
+
+	if (localPaletteSize > 0) {
+		for (int paletteGroup = 0; paletteGroup < 16 && (paletteGroup * 2 + 3) < buffer.size(); ++paletteGroup) {
+			uint16_t paletteMap = (buffer[paletteGroup * 2 + 2] | (buffer[paletteGroup * 2 + 3] << 8));
+
+			for (int colorBit = 0; colorBit < 16; ++colorBit) {
+				if (paletteMap & 0x8000) {
+					if ((34 + paletteColorIndex + 2) >= buffer.size()) break;
+					palette[paletteGroup * 16 + colorBit] = {
+						buffer[34 + paletteColorIndex],
+						buffer[34 + paletteColorIndex + 1],
+						buffer[34 + paletteColorIndex + 2]
+					};
+
+					paletteColorIndex += 3;
+				}
+
+				paletteMap <<= 1;
+			}
+		}
+	}
+
+	return localPaletteSize;
+}
+
 /*
 ===============================================================================
 Function Name: getDeltaBitmapData
@@ -29,46 +107,71 @@ Return:
 ===============================================================================
 */
 std::tuple<std::vector<RGBColor>, std::vector<uint8_t>> getDeltaBitmapData(
-	std::vector<uint8_t>& buffer,
+	std::span<const uint8_t> buffer,
 	std::vector<RGBColor>& palette,
 	std::vector<uint8_t>& frameBuffer)
 {
-	constexpr int width = 640, height = 320;
 	auto deltaFrame = frameBuffer;
+	applyDeltaBitmapData(buffer, palette, deltaFrame);
 
-	const uint16_t localPaletteSize = (buffer[0] | (buffer[1] << 8));
-	size_t paletteColorIndex = 0;
+	return { palette, deltaFrame };
+}
 
-	if (localPaletteSize > 0) {
-		for (int paletteGroup = 0; paletteGroup < 16 && (paletteGroup * 2 + 3) < buffer.size(); ++paletteGroup) {
-			uint16_t paletteMap = (buffer[paletteGroup * 2 + 2] | (buffer[paletteGroup * 2 + 3] << 8));
+/*
+===============================================================================
+Function Name: applyDeltaBitmapData
 
-			for (int colorBit = 0; colorBit < 16; ++colorBit) {
-				if (paletteMap & 0x8000) {
-					if ((34 + paletteColorIndex + 2) >= buffer.size()) break;
-					palette[paletteGroup * 16 + colorBit] = {
-						buffer[34 + paletteColorIndex],
-						buffer[34 + paletteColorIndex + 1],
-						buffer[34 + paletteColorIndex + 2]
-					};
+Description:
+	- In-place form of getDeltaBitmapData: the 0x25 opcodes are applied
+	straight onto a persistent framebuffer and the palette is updated where
+	it is, so nothing is copied or allocated per frame.
 
-					paletteColorIndex += 3;
-				}
+Parameters:
+	- buffer: Decompressed chunk data
+	- palette: Current palette; updated in place
+	- frameBuffer: Previous frame as 8-bit RGB; updated in place
+	- dirty: Optional; receives the 4x4 tiles written by this chunk (it is
+	not cleared first)
+===============================================================================
+*/
+void applyDeltaBitmapData(
+	std::span<const uint8_t> buffer,
+	std::vector<RGBColor>& palette,
+	std::vector<uint8_t>& frameBuffer,
+	DirtyTiles* dirty)
+{
+	constexpr int width = 640, height = 320;
+	constexpr size_t stride = width * 3;
 
-				paletteMap <<= 1;
-			}
-		}
-	}
+	// RGB pixels keep their colour, so a palette change alone dirties nothing
+	const uint16_t localPaletteSize = applyDeltaPalette(buffer, palette);
+
+	if (frameBuffer.size() < stride * height)
+		return;
 
 	int xPos = 0, yPos = 0;
 
-	auto updatePixel = [&](int x, int y, const RGBColor& color) {
-		const size_t pixelIndex = (y * width + x) * 3;
+	// Tile at (xPos, yPos), or nullptr once the opcodes run off the frame;
+	// asking for it marks the tile dirty
+	auto tileAt = [&]() -> uint8_t* {
+		if (xPos + 4 > width || yPos + 4 > height) return nullptr;
+		if (dirty) dirty->mark(xPos / 4, yPos / 4);
+		return frameBuffer.data() + yPos * stride + xPos * 3;
+		};
+
+	auto fillTile = [&](const RGBColor& color) {
+		if (uint8_t* tile = tileAt()) {
+			for (int y = 0; y < 4; ++y, tile += stride) {
+				for (int x = 0; x < 4; ++x) storeRGB(tile + x * 3, color);
+			}
+		}
+		};
 
-		if (pixelIndex + 2 < deltaFrame.size()) {
-			deltaFrame[pixelIndex] = color.r;
-			deltaFrame[pixelIndex + 1] = color.g;
-			deltaFrame[pixelIndex + 2] = color.b;
+	auto mapTile = [&](uint16_t mapValue, const RGBColor& color1, const RGBColor& color0) {
+		if (uint8_t* tile = tileAt()) {
+			for (int y = 0; y < 4; ++y, tile += stride, mapValue <<= 4) {
+				for (int x = 0; x < 4; ++x) storeRGB(tile + x * 3, (mapValue & (0x8000 >> x)) ? color1 : color0);
+			}
 		}
 		};
 
@@ -76,21 +179,21 @@ std::tuple<std::vector<RGBColor>, std::vector<uint8_t>> getDeltaBitmapData(
 		const uint8_t opcode = buffer[bufferIndex];
 
 		if (opcode <= 0x5F) {
-			const uint16_t mapValue = MapField[opcode << 1] | (MapField[(opcode << 1) + 1] << 8);
-			const uint8_t color1 = buffer[bufferIndex + 1], color0 = buffer[bufferIndex + 2];
-
-			for (int pixelOffset = 0; pixelOffset < 16; ++pixelOffset) {
-				const uint8_t selectedColor = ((mapValue & (0x8000 >> pixelOffset)) != 0) ? color1 : color0;
+			if (bufferIndex + 2 >= buffer.size()) break;
 
-				updatePixel(xPos + (pixelOffset % 4), yPos + (pixelOffset / 4), palette[selectedColor]);
-			}
+			mapTile(MapValues[opcode], palette[buffer[bufferIndex + 1]], palette[buffer[bufferIndex + 2]]);
 
 			xPos += 4;
 			bufferIndex += 2;
 		}
 		else if (opcode == 0x60) {
-			for (int pixelOffset = 0; pixelOffset < 16; ++pixelOffset) {
-				updatePixel(xPos + (pixelOffset % 4), yPos + (pixelOffset / 4), palette[buffer[bufferIndex + pixelOffset + 1]]);
+			if (bufferIndex + 16 >= buffer.size()) break;
+
+			if (uint8_t* tile = tileAt()) {
+				const uint8_t* indices = &buffer[bufferIndex + 1];
+				for (int y = 0; y < 4; ++y, tile += stride, indices += 4) {
+					for (int x = 0; x < 4; ++x) storeRGB(tile + x * 3, palette[indices[x]]);
+				}
 			}
 
 			xPos += 4;
@@ -104,14 +207,12 @@ std::tuple<std::vector<RGBColor>, std::vector<uint8_t>> getDeltaBitmapData(
 			xPos += (opcode - 0x62) << 2;
 		}
 		else if (opcode >= 0x6C && opcode <= 0x75) {
+			if (bufferIndex + 1 >= buffer.size()) break;
 			const int repeatCount = opcode - 0x6B;
 			const RGBColor& color = palette[buffer[bufferIndex + 1]];
 
 			for (int repeat = 0; repeat < repeatCount; ++repeat) {
-				for (int pixelOffset = 0; pixelOffset < 16; ++pixelOffset) {
-					updatePixel(xPos + (pixelOffset % 4), yPos + (pixelOffset / 4), color);
-				}
-
+				fillTile(color);
 				xPos += 4;
 			}
 
@@ -119,34 +220,299 @@ std::tuple<std::vector<RGBColor>, std::vector<uint8_t>> getDeltaBitmapData(
 		}
 		else if (opcode >= 0x76 && opcode <= 0x7F) {
 			const int colorCount = opcode - 0x75;
+			if (bufferIndex + colorCount >= buffer.size()) break;
 
 			for (int i = 1; i <= colorCount; ++i) {
-				const RGBColor& color = palette[buffer[bufferIndex + i]];
+				fillTile(palette[buffer[bufferIndex + i]]);
+				xPos += 4;
+			}
+
+			bufferIndex += colorCount;
+		}
+		else {
+			if (bufferIndex + 3 >= buffer.size()) break;
+			const uint16_t mapValue = (buffer[bufferIndex] | (buffer[bufferIndex + 1] << 8));
+
+			mapTile(mapValue, palette[buffer[bufferIndex + 2]], palette[buffer[bufferIndex + 3]]);
+
+			xPos += 4;
+			bufferIndex += 3;
+		}
+	}
+}
+
+/*
+===============================================================================
+Function Name: applyDeltaIndices
+
+Description:
+	- Applies a 0x25 chunk directly to an 8-bit palette-indexed frame. The
+	opcodes are the same as in getDeltaBitmapData, but every pixel is a
+	1-byte palette index, so no colour lookups happen while decoding.
 
-				for (int pixelOffset = 0; pixelOffset < 16; ++pixelOffset) {
-					updatePixel(xPos + (pixelOffset % 4), yPos + (pixelOffset / 4), color);
+Parameters:
+	- buffer: Decompressed chunk data
+	- frame: Previous frame; updated in place (palette and pixels)
+	- dirty: Optional; receives the 4x4 tiles written by this chunk (it is
+	not cleared first)
+
+Notes:
+	- Tiles are bounds-checked once and then written a 4-pixel row at a
+	time: two-colour tiles blend two splatted indices through RowMasks, and
+	0x6C-0x75 runs are one memset per pixel row for the whole run.
+===============================================================================
+*/
+void applyDeltaIndices(std::span<const uint8_t> buffer, IndexedFrame& frame, DirtyTiles* dirty)
+{
+	const uint16_t localPaletteSize = applyDeltaPalette(buffer, frame.palette);
+	if (dirty && localPaletteSize > 0) dirty->palette = true;
+	const int width = frame.width, height = frame.height;
+
+	int xPos = 0, yPos = 0;
+
+	// Tile at (xPos, yPos), or nullptr once the opcodes run off the frame;
+	// asking for it marks the tile dirty
+	auto tileAt = [&]() -> uint8_t* {
+		if (xPos + 4 > width || yPos + 4 > height) return nullptr;
+		if (dirty) dirty->mark(xPos / 4, yPos / 4);
+		return frame.pixels.data() + yPos * width + xPos;
+		};
+
+	auto fillTile = [&](uint8_t index) {
+		if (uint8_t* tile = tileAt()) {
+			const uint32_t row = splat(index);
+			for (int y = 0; y < 4; ++y) storeRow(tile + y * width, row);
+		}
+		};
+
+	// Both colours splatted across a 4-pixel row, blended through the row's byte mask
+	auto mapTile = [&](uint16_t mapValue, uint8_t color1, uint8_t color0) {
+		if (uint8_t* tile = tileAt()) {
+			const uint32_t row1 = splat(color1), row0 = splat(color0);
+			for (int y = 0; y < 4; ++y) {
+				const uint32_t mask = RowMasks[(mapValue >> (12 - y * 4)) & 0xF];
+				storeRow(tile + y * width, (row1 & mask) | (row0 & ~mask));
+			}
+		}
+		};
+
+	// count tiles of one index along the row, clipped once at the frame edge
+	auto fillRun = [&](uint8_t index, int count) {
+		const int tiles = yPos + 4 <= height ? std::min(count, (width - xPos) / 4) : 0;
+
+		if (tiles > 0) {
+			uint8_t* run = frame.pixels.data() + yPos * width + xPos;
+			for (int y = 0; y < 4; ++y) std::memset(run + y * width, index, size_t(tiles) * 4);
+			if (dirty) for (int i = 0; i < tiles; ++i) dirty->mark(xPos / 4 + i, yPos / 4);
+		}
+
+		xPos += count * 4;
+		};
+
+	for (size_t bufferIndex = localPaletteSize + 2; bufferIndex < buffer.size(); ++bufferIndex) {
+		const uint8_t opcode = buffer[bufferIndex];
+
+		if (opcode <= 0x5F) {
+			if (bufferIndex + 2 >= buffer.size()) break;
+
+			mapTile(MapValues[opcode], buffer[bufferIndex + 1], buffer[bufferIndex + 2]);
+
+			xPos += 4;
+			bufferIndex += 2;
+		}
+		else if (opcode == 0x60) {
+			if (bufferIndex + 16 >= buffer.size()) break;
+
+			if (uint8_t* tile = tileAt()) {
+				for (int y = 0; y < 4; ++y) {
+					std::memcpy(tile + y * width, &buffer[bufferIndex + 1 + y * 4], 4);
 				}
+			}
+
+			xPos += 4;
+			bufferIndex += 16;
+		}
+		else if (opcode == 0x61) {
+			yPos += 4;
+			xPos = 0;
+		}
+		else if (opcode >= 0x62 && opcode <= 0x6B) {
+			xPos += (opcode - 0x62) << 2;
+		}
+		else if (opcode >= 0x6C && opcode <= 0x75) {
+			if (bufferIndex + 1 >= buffer.size()) break;
+
+			fillRun(buffer[bufferIndex + 1], opcode - 0x6B);
+
+			bufferIndex += 1;
+		}
+		else if (opcode >= 0x76 && opcode <= 0x7F) {
+			const int colorCount = opcode - 0x75;
+			if (bufferIndex + colorCount >= buffer.size()) break;
 
+			for (int i = 1; i <= colorCount; ++i) {
+				fillTile(buffer[bufferIndex + i]);
 				xPos += 4;
 			}
 
 			bufferIndex += colorCount;
 		}
-		else if (opcode >= 0x80 && opcode <= 0xFF) {
+		else {
+			if (bufferIndex + 3 >= buffer.size()) break;
 			const uint16_t mapValue = (buffer[bufferIndex] | (buffer[bufferIndex + 1] << 8));
-			const RGBColor& color1 = palette[buffer[bufferIndex + 2]];
-			const RGBColor& color0 = palette[buffer[bufferIndex + 3]];
-
-			for (int pixelOffset = 0; pixelOffset < 16; ++pixelOffset) {
-				const RGBColor& selectedColor = ((mapValue & (0x8000 >> pixelOffset)) != 0) ? color1 : color0;
 
-				updatePixel(xPos + (pixelOffset % 4), yPos + (pixelOffset / 4), selectedColor);
-			}
+			mapTile(mapValue, buffer[bufferIndex + 2], buffer[bufferIndex + 3]);
 
 			xPos += 4;
 			bufferIndex += 3;
 		}
 	}
+}
 
-	return { palette, deltaFrame };
+/*
+===============================================================================
+Function Name: packDeltaBitmapData
+
+Description:
+	- The inverse of applyDeltaIndices: encodes the next frame of a clip as a
+	0x25 chunk against the frame the decoder is showing. Changed palette
+	entries are sent first, then every 4x4 tile is fitted exactly as
+	packBitmapData would fit it, and only tiles whose indices differ from
+	the previous frame are written.
+
+Parameters:
+	- rawImageData: Next frame as 8-bit RGB raw bitmap data
+	- palette: Palette of the next frame (1 to 256 colours; entries past its
+	end keep their previous colour)
+	- frame: Previous frame, fully decoded; updated in place to the next
+	frame exactly as applyDeltaIndices will reconstruct it
+
+Return:
+	- std::vector<uint8_t>: Uncompressed 0x25 chunk data
+
+Notes:
+	- Unchanged tiles become 0x62-0x6B skips and a row ends as soon as its
+	last changed tile is written. Solid tiles are grouped into 0x6C-0x75
+	runs of one colour or 0x76-0x7F lists; two-colour tiles use a MapField
+	opcode when their map, or its inverse, is one of the 96 patterns, and
+	the 4-byte explicit map otherwise.
+===============================================================================
+*/
+std::vector<uint8_t> packDeltaBitmapData(const std::vector<uint8_t>& rawImageData, const std::vector<RGBColor>& palette, IndexedFrame& frame)
+{
+	const int width = frame.width, height = frame.height;
+
+	if (!frame.tiles.empty() || width % 4 != 0 || height % 4 != 0 || frame.pixels.size() < static_cast<size_t>(width) * height)
+		throw std::runtime_error("packDeltaBitmapData: previous frame must be fully decoded and a whole number of tiles");
+
+	if (rawImageData.size() < static_cast<size_t>(width) * height * 3)
+		throw std::runtime_error("packDeltaBitmapData: image data is smaller than " + std::to_string(width) + "x" + std::to_string(height));
+
+	if (palette.empty() || palette.size() > 256)
+		throw std::runtime_error("packDeltaBitmapData: palette must have 1 to 256 colours");
+
+	std::vector<uint8_t> chunkData(2, 0);
+
+	// Local palette: a mask per group of 16 entries (bit 15 = first entry), then the changed colours
+	std::array<uint16_t, 16> paletteMaps{};
+	std::vector<uint8_t> paletteColours;
+
+	for (size_t i = 0; i < palette.size(); ++i) {
+		if (palette[i] == frame.palette[i]) continue;
+		paletteMaps[i / 16] |= 0x8000 >> (i % 16);
+		paletteColours.insert(paletteColours.end(), { palette[i].r, palette[i].g, palette[i].b });
+	}
+
+	if (!paletteColours.empty()) {
+		const size_t localPaletteSize = paletteMaps.size() * 2 + paletteColours.size();
+		chunkData[0] = static_cast<uint8_t>(localPaletteSize & 0xFF);
+		chunkData[1] = static_cast<uint8_t>(localPaletteSize >> 8);
+
+		for (uint16_t paletteMap : paletteMaps) chunkData.insert(chunkData.end(), { static_cast<uint8_t>(paletteMap & 0xFF), static_cast<uint8_t>(paletteMap >> 8) });
+		chunkData.insert(chunkData.end(), paletteColours.begin(), paletteColours.end());
+	}
+
+	PaletteMatcher matcher(palette);
+	std::vector<uint8_t> solids;        // Changed one-colour tiles not written yet
+	int rowsOwed = 0;                   // 0x61s due before the next opcode
+
+	auto flushSolids = [&]() {
+		for (size_t i = 0; i < solids.size();) {
+			size_t run = 1;
+			while (i + run < solids.size() && run < 10 && solids[i + run] == solids[i]) ++run;
+
+			if (run > 1) {
+				chunkData.insert(chunkData.end(), { static_cast<uint8_t>(0x6B + run), solids[i] });
+				i += run;
+				continue;
+			}
+
+			// List up to the start of the next run
+			size_t end = i + 1;
+			while (end < solids.size() && end - i < 10 && !(end + 1 < solids.size() && solids[end + 1] == solids[end])) ++end;
+
+			chunkData.push_back(static_cast<uint8_t>(0x75 + (end - i)));
+			chunkData.insert(chunkData.end(), solids.begin() + i, solids.begin() + end);
+			i = end;
+		}
+		solids.clear();
+		};
+
+	for (int tileY = 0; tileY < height / 4; ++tileY, ++rowsOwed) {
+		int skipped = 0;
+
+		for (int tileX = 0; tileX < width / 4; ++tileX) {
+			std::array<RGBColor, 16> pixels;
+			for (int y = 0; y < 4; ++y) {
+				const uint8_t* row = rawImageData.data() + ((tileY * 4 + y) * static_cast<size_t>(width) + tileX * 4) * 3;
+				for (int x = 0; x < 4; ++x, row += 3)
+					pixels[x + y * 4] = { row[0], row[1], row[2] };
+			}
+
+			auto [colour1, colour0, mapLow, mapHigh] = fitTile(pixels, matcher);
+			uint16_t mapValue = static_cast<uint16_t>(mapLow | (mapHigh << 8));
+
+			const uint8_t* previous = frame.pixels.data() + tileY * 4 * width + tileX * 4;
+			bool unchanged = true;
+			for (int i = 0; i < 16 && unchanged; ++i)
+				unchanged = previous[(i / 4) * width + i % 4] == ((mapValue & (0x8000 >> i)) ? colour1 : colour0);
+
+			if (unchanged) {
+				flushSolids();
+				++skipped;
+				continue;
+			}
+
+			chunkData.insert(chunkData.end(), rowsOwed, 0x61);
+			rowsOwed = 0;
+			for (; skipped > 0; skipped -= std::min(skipped, 9))
+				chunkData.push_back(static_cast<uint8_t>(0x62 + std::min(skipped, 9)));
+
+			if (colour1 == colour0 || mapValue == 0 || mapValue == 0xFFFF) {
+				solids.push_back(mapValue == 0xFFFF ? colour1 : colour0);
+				continue;
+			}
+
+			flushSolids();
+
+			if (const int opcode = mapOpcode(mapValue); opcode >= 0)
+				chunkData.insert(chunkData.end(), { static_cast<uint8_t>(opcode), colour1, colour0 });
+			else if (const int inverse = mapOpcode(static_cast<uint16_t>(~mapValue)); inverse >= 0)
+				chunkData.insert(chunkData.end(), { static_cast<uint8_t>(inverse), colour0, colour1 });
+			else {
+				// The low byte doubles as the opcode, so pixel 8 must take colour1
+				if (!(mapValue & 0x80)) {
+					mapValue = static_cast<uint16_t>(~mapValue);
+					std::swap(colour1, colour0);
+				}
+				chunkData.insert(chunkData.end(), { static_cast<uint8_t>(mapValue & 0xFF), static_cast<uint8_t>(mapValue >> 8), colour1, colour0 });
+			}
+		}
+
+		flushSolids();
+	}
+
+	applyDeltaIndices(chunkData, frame);
+
+	return chunkData;
 }
\ No newline at end of file
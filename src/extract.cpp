@@ -3,29 +3,41 @@
 #include <iostream>
 #include <string>
 #include <vector>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
 #include <filesystem>
 #include <fstream>
 #include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
 
 #include "extract.h"
 
 #include "rl.h"
 #include "gjd.h"
+#include "gjdindex.h"
 #include "vdx.h"
 #include "xmi.h"
 #include "bitmap.h"
+#include "threadpool.h"
 
 // Output the information for a GJD file
 void GJDInfo(const std::string_view& filename)
 {
-	auto vdxFiles = parseRLFile(filename.data());
+	GJDIndex gjdIndex = loadGJDIndex(std::string(filename));
 
-	for (const auto& vdxFile : vdxFiles)
+	for (const auto& entry : gjdIndex.entries)
 	{
-		std::cout << vdxFile.filename << " | " << vdxFile.offset << " | " << vdxFile.length << std::endl;
+		std::cout << std::string(entry.filename, strnlen(entry.filename, sizeof(entry.filename))) << " | " << entry.offset << " | " << entry.length <<
+			" | " << entry.chunkCount << " chunks" << std::endl;
 	}
 
-	std::cout << "Number of VDX Files: " << vdxFiles.size() << std::endl;
+	std::cout << "Number of VDX Files: " << gjdIndex.entries.size() << std::endl;
 }
 
 // Extract XMI files from the RL/GJD pair
@@ -53,9 +65,17 @@ void extractVDX(const std::string_view& filename)
 	}
 }
 
+// <vdx name>_<chunk number, 4 digits><extension>, as used by every frame extractor
+static std::string frameFilename(const std::string& vdxName, size_t chunkNumber, const char* extension)
+{
+	std::ostringstream frameString;
+	frameString << vdxName << "_" << std::setfill('0') << std::setw(4) << chunkNumber << extension;
+	return frameString.str();
+}
+
 // Writes out a *.PNG or *.RAW of every 0x20 and 0x25 chunk in the user-specified *.VDX file
 // as a full 640x320 bitmap
-void extractPNG(const std::string_view& filename, bool raw)
+void extractPNG(const std::string_view& filename, bool raw, const PNGOptions& pngOptions)
 {
 	std::ifstream vdxFile(filename.data(), std::ios::binary | std::ios::ate);
 
@@ -71,8 +91,11 @@ void extractPNG(const std::string_view& filename, bool raw)
 	std::vector<uint8_t> vdxData(fileSize);
 	vdxFile.read(reinterpret_cast<char*>(vdxData.data()), fileSize);
 
-	VDXFile parsedVDXFile = parseVDXFile(filename.data(), vdxData);
-	parseVDXChunks(parsedVDXFile);
+	VDXFile parsedVDXFile = parseVDXFile(filename.data(), std::move(vdxData));
+
+	// Indexed output needs the palette indices, which only the stream keeps
+	if (!pngOptions.indexed || raw)
+		parseVDXChunks(parsedVDXFile);
 
 	std::filesystem::path dirPath = (std::filesystem::path(filename.data()).parent_path() /
 		[](std::string s) { std::replace(s.begin(), s.end(), '.', '_'); return s; }
@@ -84,6 +107,26 @@ void extractPNG(const std::string_view& filename, bool raw)
 		return;
 	}
 
+	PNGEncoder encoder(pngOptions);
+	AsyncFileWriter writer;
+
+	if (pngOptions.indexed && !raw)
+	{
+		VDXStream stream = openVDXStream(parsedVDXFile);
+
+		while (stream.next())
+		{
+			std::filesystem::path outputFilePath = dirPath / frameFilename(parsedVDXFile.filename, stream.nextChunk, ".png");
+			std::cout << "Writing: " << outputFilePath.string() << std::endl;
+
+			std::vector<uint8_t> png = writer.acquire();
+			encoder.encode(stream.frame, png);
+			writer.write(std::move(outputFilePath), std::move(png));
+		}
+
+		return;
+	}
+
 	for (std::size_t i = 0; i < parsedVDXFile.chunks.size(); i++)
 	{
 		if (parsedVDXFile.chunks[i].chunkType == 0x80)
@@ -100,81 +143,356 @@ void extractPNG(const std::string_view& filename, bool raw)
 			" , LZSS size (bytes): " << std::dec << parsedVDXFile.chunks[i].dataSize <<
 			" , Size (bytes): " << parsedVDXFile.chunks[i].data.size() << std::endl;
 
-		std::ostringstream frameString;
-		frameString << std::setfill('0') << std::setw(4) << i + 1;
-
-		std::filesystem::path outputFilePath = dirPath;
+		std::filesystem::path outputFilePath = dirPath / frameFilename(parsedVDXFile.filename, i + 1, raw ? ".raw" : ".png");
+		std::cout << "Writing: " << outputFilePath.string() << std::endl;
 
 		if (raw)
 		{
-			outputFilePath /= (parsedVDXFile.filename + "_" + frameString.str() + ".raw");
-			std::ofstream rawBitmapFile(outputFilePath, std::ios::binary);
-			std::cout << "Writing: " << outputFilePath.string() << std::endl;
-			rawBitmapFile.write(reinterpret_cast<const char*>(parsedVDXFile.chunks[i].data.data()), parsedVDXFile.chunks[i].data.size());
-			rawBitmapFile.close();
+			writer.write(std::move(outputFilePath), parsedVDXFile.chunks[i].data);
 		}
 		else
 		{
-			outputFilePath /= (parsedVDXFile.filename + "_" + frameString.str() + ".png");
-			std::cout << "Writing: " << outputFilePath.string() << std::endl;
-			savePNG(outputFilePath.string(), parsedVDXFile.chunks[i].data, 640, 320);
+			std::vector<uint8_t> png = writer.acquire();
+			encoder.encodeRGB(parsedVDXFile.chunks[i].data.data(), 640, 320, png);
+			writer.write(std::move(outputFilePath), std::move(png));
 		}
 	}
 }
 
-//
-// Invokes FFmpeg to create a video from a directory of *.PNG files
-//
-void createVideoFromImages(const std::string& filenameParam) {
-	if (std::system("ffmpeg -version") != 0) {
-		std::cerr << "FFMPEG is not installed or is not in the system %PATH% variable." << std::endl;
+/*
+===============================================================================
+Function Name: extractPNGBatch
+
+Description:
+	- Writes out a *.PNG or *.RAW of every frame of every VDX in an RL/GJD
+	pair, or in a directory of *.VDX (and *.RL) files, across a thread pool.
+	Each clip is decoded by one task, which hands every frame to the pool
+	to be encoded while it carries on decoding. Encoded frames go to disk
+	through a single AsyncFileWriter.
+	- Prints frames/s and MB/s once everything has been written.
+
+Parameters:
+	- path: *.RL file or directory
+	- raw: Write *.RAW instead of *.PNG
+	- pngOptions: Compression settings and RGB/indexed output
+
+Notes:
+	- Output goes to <RL name>/<vdx name>_vdx/ per archive clip, and next to
+	the file as with extractPNG for loose *.VDX files. Frame numbers are
+	chunk numbers, matching extractPNG.
+	- Frames are always composited; the "alpha" devMode output is only
+	available from the single-file extractPNG.
+===============================================================================
+*/
+void extractPNGBatch(const std::string_view& path, bool raw, const PNGOptions& pngOptions)
+{
+	struct Clip
+	{
+		const VDXFile* vdxFile;
+		std::filesystem::path dirPath;
+	};
+
+	const std::filesystem::path inputPath(path);
+	std::deque<GJDArchive> archives;
+	std::deque<VDXFile> looseFiles;
+	std::vector<Clip> clips;
+
+	auto addArchive = [&](const std::filesystem::path& rlPath)
+	{
+		GJDArchive& archive = archives.emplace_back(openGJDArchive(rlPath.string()));
+		std::filesystem::path archiveDir = rlPath.parent_path() / rlPath.stem();
+
+		for (const auto& entry : archive.entries)
+		{
+			const std::string name = vdxNameFor(entry);
+			if (const VDXFile* vdxFile = archive.getVDX(name))
+				clips.push_back({ vdxFile, archiveDir / (name + "_vdx") });
+		}
+	};
+
+	auto addVDX = [&](const std::filesystem::path& vdxPath)
+	{
+		std::ifstream vdxFile(vdxPath, std::ios::binary | std::ios::ate);
+		if (!vdxFile)
+		{
+			std::cerr << "ERROR: Failed to open the VDX file: " << vdxPath << std::endl;
+			return;
+		}
+
+		std::vector<uint8_t> vdxData(static_cast<std::size_t>(vdxFile.tellg()));
+		vdxFile.seekg(0, std::ios::beg);
+		vdxFile.read(reinterpret_cast<char*>(vdxData.data()), vdxData.size());
+
+		std::string dirName = vdxPath.filename().string();
+		std::replace(dirName.begin(), dirName.end(), '.', '_');
+
+		const VDXFile& parsed = looseFiles.emplace_back(parseVDXFile(vdxPath.stem().string(), std::move(vdxData)));
+		clips.push_back({ &parsed, vdxPath.parent_path() / dirName });
+	};
+
+	auto extensionIs = [](const std::filesystem::path& file, std::string_view extension)
+	{
+		std::string ext = file.extension().string();
+		std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+		return ext == extension;
+	};
+
+	if (std::filesystem::is_directory(inputPath))
+	{
+		std::vector<std::filesystem::path> files;
+		for (const auto& entry : std::filesystem::directory_iterator(inputPath))
+		{
+			if (entry.is_regular_file())
+				files.push_back(entry.path());
+		}
+		std::sort(files.begin(), files.end());
+
+		for (const auto& file : files)
+		{
+			if (extensionIs(file, ".rl"))
+				addArchive(file);
+			else if (extensionIs(file, ".vdx"))
+				addVDX(file);
+		}
+	}
+	else if (extensionIs(inputPath, ".rl"))
+	{
+		addArchive(inputPath);
+	}
+	else
+	{
+		std::cerr << "ERROR: Expected a *.RL file or a directory: " << path << std::endl;
 		return;
 	}
 
-	std::string workingDirectory = std::filesystem::current_path().string();
+	if (clips.empty())
+	{
+		std::cerr << "ERROR: No VDX files found in: " << path << std::endl;
+		return;
+	}
+
+	for (const auto& clip : clips)
+	{
+		std::error_code error;
+		std::filesystem::create_directories(clip.dirPath, error);
+		if (error)
+		{
+			std::cerr << "ERROR: Failed to create the directory: " << clip.dirPath << std::endl;
+			return;
+		}
+	}
+
+	std::atomic<size_t> failures{ 0 };
+	std::atomic<size_t> framesInFlight{ 0 };
+	std::mutex logMutex;
+
+	const auto startTime = std::chrono::steady_clock::now();
+
+	// Declared before the pool so every frame task is done with it first
+	AsyncFileWriter writer;
+
+	{
+		ThreadPool pool;
+
+		// Decoding outruns encoding, so past this many queued frames the
+		// decoding task encodes the frame itself instead of queueing it
+		const size_t maxInFlight = pool.size() * 4;
 
-	std::filesystem::path filepath(filenameParam);
-	std::string baseDirectory = filepath.parent_path().string();
-	std::string filenameWithoutExtension = filepath.stem().string();
+		auto writeFrame = [&](std::filesystem::path outputFilePath, const IndexedFrame& frame)
+		{
+			try
+			{
+				if (raw)
+				{
+					writer.write(std::move(outputFilePath), expandToRGB(frame));
+					return;
+				}
+
+				thread_local PNGEncoder encoder;
+				encoder.setOptions(pngOptions);
+
+				std::vector<uint8_t> png = writer.acquire();
+				encoder.encode(frame, png);
+				writer.write(std::move(outputFilePath), std::move(png));
+			}
+			catch (const std::exception& e)
+			{
+				++failures;
+				std::lock_guard lock(logMutex);
+				std::cerr << "ERROR: " << e.what() << std::endl;
+			}
+		};
+
+		for (const auto& clip : clips)
+		{
+			pool.submit([&, &clip = clip]
+				{
+					VDXStream stream = openVDXStream(*clip.vdxFile);
+
+					while (stream.next())
+					{
+						std::filesystem::path outputFilePath = clip.dirPath /
+							frameFilename(clip.vdxFile->filename, stream.nextChunk, raw ? ".raw" : ".png");
+
+						if (framesInFlight.load(std::memory_order_relaxed) >= maxInFlight)
+						{
+							writeFrame(std::move(outputFilePath), stream.frame);
+							continue;
+						}
+
+						++framesInFlight;
+						pool.submit([&, outputFilePath = std::move(outputFilePath), frame = stream.frame]() mutable
+							{
+								writeFrame(std::move(outputFilePath), frame);
+								--framesInFlight;
+							});
+					}
+
+					std::lock_guard lock(logMutex);
+					std::cout << "Decoded: " << clip.dirPath.string() << " (" << stream.framesDecoded << " frames)" << std::endl;
+				});
+		}
 
-	if (!baseDirectory.empty() && baseDirectory[0] == '.' && (baseDirectory[1] == '\\' || baseDirectory[1] == '/')) {
-		baseDirectory = baseDirectory.substr(2);
+		pool.wait();
 	}
 
-	std::replace(filenameWithoutExtension.begin(), filenameWithoutExtension.end(), '.', '_');
+	writer.flush();
 
-	// Windows only
-	std::string pngDirectory = workingDirectory + "\\" + baseDirectory + "\\" + filenameWithoutExtension;
-	std::replace(pngDirectory.begin(), pngDirectory.end(), '/', '\\');
+	const size_t framesWritten = writer.filesWritten();
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+	const double megabytes = static_cast<double>(writer.bytesWritten()) / (1024.0 * 1024.0);
 
-	std::string pngFilename = filenameWithoutExtension;
-	size_t lastUnderscorePos = pngFilename.find_last_of('_');
-	if (lastUnderscorePos != std::string::npos) {
-		pngFilename[lastUnderscorePos] = '.';
+	std::cout << "\nClips: " << clips.size() << " , Frames: " << framesWritten << " , Failed: " << failures + writer.failures() << std::endl;
+	std::cout << "Written: " << std::fixed << std::setprecision(1) << megabytes << " MB in " << std::setprecision(2) << seconds << " s" << std::endl;
+	if (seconds > 0.0)
+	{
+		std::cout << std::setprecision(1) << framesWritten / seconds << " frames/s , " <<
+			megabytes / seconds << " MB/s" << std::endl;
 	}
+	std::cout << std::defaultfloat;
+}
+
+// Palette-expand a frame to RGB24, drawing every pixel as a scale x scale block
+static void scaleToRGB(const IndexedFrame& frame, int scale, std::vector<uint8_t>& out)
+{
+	const size_t rowBytes = static_cast<size_t>(frame.width) * scale * 3;
+	out.resize(rowBytes * frame.height * scale);
+
+	uint8_t* dst = out.data();
+	for (int y = 0; y < frame.height; ++y)
+	{
+		uint8_t* row = dst;
+		const uint8_t* src = frame.pixels.data() + static_cast<size_t>(y) * frame.width;
 
-	// Iterate over PNG files in the directory and resize them
-	for (const auto& entry : std::filesystem::directory_iterator(pngDirectory)) {
-		if (entry.path().extension() == ".png") {
-			std::string filePath = entry.path().string();
-			std::string magickCommand = "magick \"" + filePath + "\" -resize 200% -filter point \"" + filePath + "\"";
-			std::system(magickCommand.c_str());
+		for (int x = 0; x < frame.width; ++x)
+		{
+			const RGBColor& color = frame.palette[src[x]];
+			for (int i = 0; i < scale; ++i)
+			{
+				*dst++ = color.r;
+				*dst++ = color.g;
+				*dst++ = color.b;
+			}
 		}
+
+		// Repeat the scaled row for the remaining lines of the block
+		for (int i = 1; i < scale; ++i, dst += rowBytes)
+			std::memcpy(dst, row, rowBytes);
 	}
+}
 
-	std::string command = "ffmpeg -framerate 15 -i \"" + pngDirectory +
-		"\\" + pngFilename + "_%04d.png\" -c:v libx265 -crf 0 -pix_fmt rgb24 \"" +
-		pngDirectory + "\\" + filenameWithoutExtension + ".mkv\"";
+/*
+===============================================================================
+Function Name: exportVideo
 
-	int result = std::system(command.c_str());
+Description:
+	- Encodes a *.VDX clip to a lossless *.MKV with FFmpeg. Frames are
+	decoded, palette-expanded and scaled up in-process and written to
+	FFmpeg's stdin as raw RGB24, so nothing passes through the disk and
+	only one process is started.
+	- Plays the result with ffplay once it has been written.
 
-	if (result != 0) {
-		std::cerr << "FFMPEG command execution failed." << std::endl;
+Parameters:
+	- filename: *.VDX file to encode
+	- scale: Integer nearest-neighbour scale factor
+	- fps: Frame rate of the output
+
+Notes:
+	- The output is written next to the input as <name>_vdx.mkv.
+===============================================================================
+*/
+void exportVideo(const std::string_view& filename, int scale, int fps)
+{
+	if (std::system("ffmpeg -version") != 0) {
+		std::cerr << "FFMPEG is not installed or is not in the system %PATH% variable." << std::endl;
+		return;
+	}
+
+	std::ifstream vdxFile(filename.data(), std::ios::binary | std::ios::ate);
+
+	if (!vdxFile)
+	{
+		std::cerr << "ERROR: Failed to open the VDX file: " << filename << std::endl;
+		return;
+	}
+
+	std::vector<uint8_t> vdxData(static_cast<std::size_t>(vdxFile.tellg()));
+	vdxFile.seekg(0, std::ios::beg);
+	vdxFile.read(reinterpret_cast<char*>(vdxData.data()), vdxData.size());
+
+	const std::filesystem::path inputPath(filename);
+	std::string outputName = inputPath.filename().string();
+	std::replace(outputName.begin(), outputName.end(), '.', '_');
+	const std::filesystem::path outputPath = inputPath.parent_path() / (outputName + ".mkv");
+
+	VDXFile parsedVDXFile = parseVDXFile(inputPath.stem().string(), std::move(vdxData));
+	VDXStream stream = openVDXStream(parsedVDXFile);
+
+	const int width = 640 * scale;
+	const int height = 320 * scale;
+
+	std::string command = "ffmpeg -y -loglevel error -f rawvideo -pix_fmt rgb24 -s " +
+		std::to_string(width) + "x" + std::to_string(height) + " -framerate " + std::to_string(fps) +
+		" -i - -c:v libx265 -crf 0 -pix_fmt rgb24 \"" + outputPath.string() + "\"";
+
+	FILE* pipe = _popen(command.c_str(), "wb");
+	if (!pipe)
+	{
+		std::cerr << "ERROR: Failed to start FFMPEG." << std::endl;
+		return;
+	}
+
+	std::vector<uint8_t> rgb;
+	size_t frames = 0;
+	bool writeFailed = false;
+	const auto startTime = std::chrono::steady_clock::now();
+
+	while (stream.next())
+	{
+		scaleToRGB(stream.frame, scale, rgb);
+
+		if (std::fwrite(rgb.data(), 1, rgb.size(), pipe) != rgb.size())
+		{
+			writeFailed = true;
+			break;
+		}
+
+		++frames;
 	}
-	else {
-		std::string ffplayCommand = "ffplay -loop 0 \"" + pngDirectory + "\\" + filenameWithoutExtension + ".mkv\"";
-		std::system(ffplayCommand.c_str());
+
+	const int result = _pclose(pipe);
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+	if (writeFailed || result != 0) {
+		std::cerr << "FFMPEG command execution failed." << std::endl;
+		return;
 	}
+
+	std::cout << "Encoded " << frames << " frames to " << outputPath.string() << " in " <<
+		std::fixed << std::setprecision(2) << seconds << " s" << std::defaultfloat << std::endl;
+
+	std::string ffplayCommand = "ffplay -loop 0 \"" + outputPath.string() + "\"";
+	std::system(ffplayCommand.c_str());
 }
 
 /*
@@ -194,58 +512,26 @@ Return:
 	- TBD
 
 Notes:
-	- x
+	- Synchronous, with default PNGOptions. Extraction loops should use a
+	PNGEncoder and AsyncFileWriter directly.
 ===============================================================================
 */
 void savePNG(const std::string& filename, const std::vector<uint8_t>& imageData, int width, int height)
 {
-	FILE* fp;
-	errno_t err = fopen_s(&fp, filename.c_str(), "wb");
-	if (err != 0 || !fp)
-	{
-		throw std::runtime_error("Failed to open file for writing: " + filename);
-	}
-
-	png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
-	if (!png_ptr)
-	{
-		fclose(fp);
-		throw std::runtime_error("Failed to create PNG write struct");
-	}
+	thread_local PNGEncoder encoder;
+	thread_local std::vector<uint8_t> png;
 
-	png_infop info_ptr = png_create_info_struct(png_ptr);
-	if (!info_ptr)
-	{
-		fclose(fp);
-		png_destroy_write_struct(&png_ptr, nullptr);
-		throw std::runtime_error("Failed to create PNG info struct");
-	}
+	encoder.encodeRGB(imageData.data(), width, height, png);
 
-	if (setjmp(png_jmpbuf(png_ptr)))
+	std::ofstream file(filename, std::ios::binary);
+	if (!file)
 	{
-		fclose(fp);
-		png_destroy_write_struct(&png_ptr, &info_ptr);
-		throw std::runtime_error("Error during PNG initialization");
+		throw std::runtime_error("Failed to open file for writing: " + filename);
 	}
 
-	png_init_io(png_ptr, fp);
-
-	png_set_IHDR(png_ptr, info_ptr, width, height,
-		8, PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE,
-		PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
-
-	png_write_info(png_ptr, info_ptr);
-
-	std::vector<png_bytep> row_pointers(height);
-	for (int y = 0; y < height; ++y)
+	file.write(reinterpret_cast<const char*>(png.data()), png.size());
+	if (!file)
 	{
-		row_pointers[y] = const_cast<uint8_t*>(&imageData[y * width * 3]);
+		throw std::runtime_error("Failed to write PNG file: " + filename);
 	}
-
-	png_write_image(png_ptr, row_pointers.data());
-
-	png_write_end(png_ptr, nullptr);
-
-	fclose(fp);
-	png_destroy_write_struct(&png_ptr, &info_ptr);
 }
\ No newline at end of file
@@ -1,9 +1,8 @@
 // game.cpp
 
 #include <iostream>
-#include <unordered_map>
+#include <array>
 #include <string>
-#include <string_view>
 #include <ranges>
 #include <algorithm>
 #include <chrono>
@@ -13,6 +12,8 @@
 #include "gjd.h"
 #include "fh.h"
 #include "config.h"
+#include "pixel.h"
+#include "profiler.h"
 
 /* ============================================================================
 							Game Engine Feature
@@ -22,96 +23,158 @@
 GameState state;
 
 //
-// View Prefixes
+// Views of every room, indexed by ViewId; nullptr where a view has no table entry yet
 //
-const std::unordered_map<std::string_view, const std::unordered_map<std::string, View>*> viewPrefixes = {
-	{ "f_", &f_ },      // Foyer sequences
-	// ...
-};
+static constexpr auto VIEWS = [] {
+	std::array<const View*, VIEW_NAMES.size()> table{};
+	for (const View& view : f_) {
+		table[view.id] = &view;
+	}
+	return table;
+}();
+
+//
+// Retrieve a View by ID
+//
+const View* getView(ViewId id) {
+	return id < VIEWS.size() ? VIEWS[id] : nullptr;
+}
 
 //
-// Retrieve the View string from one of the view prefix maps
-// 
-const View* getView(const std::string& current_view) {
-	for (const auto& [prefix, view_map_ptr] : viewPrefixes) {
-		if (current_view.starts_with(prefix)) {
-			auto it = view_map_ptr->find(current_view);
-			if (it != view_map_ptr->end()) {
-				return &it->second;
+// Fade to the theme configured for the current room ("music" in config.json, keyed by RL file)
+//
+static void playRoomMusic() {
+	if (!config.value("midiEnabled", true)) {
+		return;
+	}
+
+	const std::string room = ROOM_DATA.at(state.current_room);
+	std::string theme;
+
+	// A hand-edited entry of the wrong type is skipped rather than thrown on
+	if (auto themes = config.find("music"); themes != config.end()) {
+		if (!themes->is_object()) {
+			std::cerr << "ERROR: \"music\" in config.json must map RL files to XMI names" << std::endl;
+		}
+		else if (auto entry = themes->find(room); entry != themes->end()) {
+			if (entry->is_string()) {
+				theme = entry->get<std::string>();
+			}
+			else {
+				std::cerr << "ERROR: Music for " << room << " in config.json must be an XMI name" << std::endl;
 			}
 		}
 	}
-	return nullptr;
+
+	if (theme.empty()) {
+		state.music.stop();
+	}
+	else if (theme != state.music.current()) {
+		state.music.play(theme);
+	}
 }
 
 //
 //  Setup VDX animation sequence
 //
 void loadView() {
-	if (state.current_room != state.previous_room) {
-		state.VDXFiles = parseGJDFile(ROOM_DATA.at(state.current_room));
+	profiler.restartFrame();
+	ScopedTimer timer(ProfileScope::LoadView);
+
+	// Archives stay open once visited, so cached clips from other rooms remain valid
+	if (state.current_room != state.previous_room || !state.archive) {
+		state.playback.stop();
+		state.currentVDX = nullptr;
+		state.animation.reset();
+
+		auto it = state.archives.find(state.current_room);
+		if (it == state.archives.end()) {
+			it = state.archives.emplace(state.current_room, openGJDArchive(ROOM_DATA.at(state.current_room))).first;
+		}
+		state.archive = &it->second;
 		state.previous_room = state.current_room;
+		playRoomMusic();
 	}
 
 	const View* newView = getView(state.current_view);
-	state.view = *newView;
+	VDXFile* vdxFile = newView ? state.archive->getVDX(std::string(viewName(state.current_view))) : nullptr;
+
+	if (!vdxFile) {
+		state.current_view = state.previous_view;
+		return;
+	}
 
-	auto it = std::ranges::find_if(state.VDXFiles, [&](const VDXFile& file) {
-		return file.filename == state.current_view;
-		});
-	state.currentVDX = &(*it);
+	state.view = newView;
+	state.hitGrid.build(*state.view);
+	state.currentVDX = vdxFile;
 
-	if (!state.currentVDX->parsed) {
-		parseVDXChunks(*state.currentVDX);
-		state.currentVDX->parsed = true;
+	// Frame 0 is ready on return; the worker decodes the rest in the background
+	if (auto warm = state.clipCache.find({ state.current_room, state.current_view })) {
+		state.playback.start(std::move(*warm));
+	}
+	else {
+		state.playback.start(*state.currentVDX, state.gpuTileDecode);
 	}
 
-	state.animation.totalFrames = state.currentVDX->chunks.size();
+	state.dirty.markAll();
+
+	state.animation.totalFrames = countVDXFrames(*state.currentVDX);
 	state.currentFrameIndex = 0;
-	state.animation.isPlaying = true;
-	state.animation.lastFrameTime = std::chrono::steady_clock::now();
+	state.animation.isPlaying = state.animation.totalFrames > 1;
+	state.animation.start(std::chrono::steady_clock::now(), state.currentFPS);
 
 	renderFrame();
 
+	prefetchNavigations();
+
 	state.previous_view = state.current_view;
 }
 
+//
+// Warm the clips the player can reach from the current view
+//
+void prefetchNavigations() {
+	std::vector<Prefetcher::Target> targets;
+
+	for (const auto& nav : state.view->navigations) {
+		if (nav.next_view == state.current_view || !getView(nav.next_view)) {
+			continue;
+		}
+
+		if (VDXFile* vdxFile = state.archive->getVDX(std::string(viewName(nav.next_view)))) {
+			targets.push_back({ { state.current_room, nav.next_view }, vdxFile, state.gpuTileDecode });
+		}
+	}
+
+	state.prefetch.request(std::move(targets));
+}
+
+//
+// Navigation or hotspot under the mouse cursor
+//
+HitTarget hitTestCursor() {
+	POINT cursorPos;
+	GetCursorPos(&cursorPos);
+	ScreenToClient(hwnd, &cursorPos);
+
+	const float normalizedX = static_cast<float>(cursorPos.x) / state.ui.width * 100.0f;
+	const float normalizedY = static_cast<float>(cursorPos.y) / state.ui.height * 100.0f;
+
+	return state.hitGrid.query(normalizedX, normalizedY);
+}
+
 //
 // Click event handler
 //
 void handleClick() {
 	if (!state.animation.isPlaying && state.currentVDX) {
-		POINT cursorPos;
-		GetCursorPos(&cursorPos);
-		ScreenToClient(hwnd, &cursorPos);
-
-		float normalizedX = static_cast<float>(cursorPos.x) / state.ui.width * 100.0f;
-		float normalizedY = static_cast<float>(cursorPos.y) / state.ui.height * 100.0f;
-
-		// Navigation
-		for (const auto& nav : state.view.navigations) {
-			if (normalizedX >= nav.hotspot.x &&
-				normalizedX <= (nav.hotspot.x + nav.hotspot.width) &&
-				normalizedY >= nav.hotspot.y &&
-				normalizedY <= (nav.hotspot.y + nav.hotspot.height)) {
-
-				state.current_view = nav.next_view;
-				return;
-			}
-		}
+		const HitTarget target = hitTestCursor();
 
-		// Hotspots
-		for (const auto& hotspot : state.view.hotspots) {
-			if (normalizedX >= hotspot.x &&
-				normalizedX <= (hotspot.x + hotspot.width) &&
-				normalizedY >= hotspot.y &&
-				normalizedY <= (hotspot.y + hotspot.height)) {
-
-				if (hotspot.action) {
-					hotspot.action();
-				}
-				return;
-			}
+		if (target.navigation) {
+			state.current_view = target.navigation->next_view;
+		}
+		else if (target.hotspot && target.hotspot->action) {
+			target.hotspot->action();
 		}
 	}
 }
@@ -124,30 +187,85 @@ void updateAnimation() {
 		return;
 	}
 
-	auto currentTime = std::chrono::steady_clock::now();
-	auto elapsedTime = currentTime - state.animation.lastFrameTime;
+	AnimationState& animation = state.animation;
+	const auto currentTime = std::chrono::steady_clock::now();
 
-	// Check if it's time for next frame based on current FPS setting
-	if (elapsedTime >= state.animation.getFrameDuration(state.currentFPS)) {
-		state.currentFrameIndex++;
+	animation.retime(state.currentFPS, state.playback.currentIndex(), currentTime);
 
-		// Check for end of animation
-		if (state.currentFrameIndex >= state.animation.totalFrames) {
-			state.animation.isPlaying = false;
-			state.currentFrameIndex = state.animation.totalFrames - 1; // Hold on last frame
-			renderFrame();
-			return;
-		}
+	const size_t target = animation.frameAt(currentTime);
+	if (target <= state.playback.currentIndex()) {
+		return;
+	}
+
+	// Step to the frame the timeline wants, as far as the decoder has got;
+	// skipped frames are folded into a single present
+	DirtyTiles changed;
+	size_t stepped = 0;
+
+	while (state.playback.currentIndex() < target && state.playback.advance()) {
+		changed.merge(state.playback.current()->dirty);
+		++stepped;
+	}
 
-		state.animation.lastFrameTime = currentTime;
+	// The pipeline holds on the last frame
+	if (state.playback.finished()) {
+		animation.isPlaying = false;
+	}
+
+	if (stepped == 0) {
+		return;	// Decoder is behind; show the frame as soon as it lands
+	}
+
+	state.currentFrameIndex = state.playback.currentIndex();
+
+	animation.droppedFrames += stepped - 1;
+	if (currentTime >= animation.dueTime(state.currentFrameIndex + 1)) {
+		++animation.lateFrames;
+	}
+
+	// Frames that change nothing are not presented at all
+	if (!changed.empty()) {
+		state.dirty.merge(changed);
 		renderFrame();
 	}
 }
 
+//
+// When the main loop next has animation work to do; max() if nothing is animating
+//
+static std::chrono::steady_clock::time_point nextFrameDeadline() {
+	if (!state.animation.isPlaying || !state.currentVDX) {
+		return std::chrono::steady_clock::time_point::max();
+	}
+
+	const auto now = std::chrono::steady_clock::now();
+	const auto due = state.animation.dueTime(state.playback.currentIndex() + 1);
+
+	// Already due but not shown: the decoder is behind, so check back shortly
+	return due > now ? due : now + std::chrono::milliseconds(1);
+}
+
+//
+// Frame currently on screen (640x320 palette indices), nullptr if none
+//
+const IndexedFrame* currentFrame() {
+	const DecodedFrame* decoded = state.playback.current();
+	return decoded ? &decoded->frame : nullptr;
+}
+
 //
 // Start the game engine
 //
 void init() {
+	state.clipCache.setBudget(static_cast<size_t>(config.value("cacheBudgetMB", 256)) * 1024 * 1024);
+
+	if (config["devMode"]) {
+		std::cout << "Pixel kernels: " << pixelKernelName() << std::endl;
+		profiler.enable(true);
+	}
+
+	state.music.setVolume(config.value("midiVolume", 100));
+
 	initWindow();
 	loadView();
 
@@ -163,6 +281,28 @@ void init() {
 		}
 
 		updateAnimation();
+
+		// Sleep until the next frame is due or a message arrives
+		if (running) {
+			waitForEvents(nextFrameDeadline());
+		}
+	}
+
+	state.playback.stop();
+	state.music.shutdown();
+
+	if (config["devMode"]) {
+		const ClipCache::Stats stats = state.clipCache.stats();
+		std::cout << "Clip cache: " << stats.hits << " hits, " << stats.misses << " misses, "
+			<< stats.clips << " clips, " << stats.bytes / (1024 * 1024) << " / "
+			<< stats.budget / (1024 * 1024) << " MB" << std::endl;
+		std::cout << "Frames: " << state.animation.lateFrames << " late, "
+			<< state.animation.droppedFrames << " dropped" << std::endl;
+
+		const std::string traceFile = config.value("traceFile", std::string());
+		if (!traceFile.empty() && profiler.writeTrace(traceFile)) {
+			std::cout << "Trace: " << traceFile << std::endl;
+		}
 	}
 
 	save_config("config.json");
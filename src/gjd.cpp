@@ -5,50 +5,217 @@
 #include <string>
 #include <vector>
 #include <iostream>
+#include <span>
+#include <algorithm>
 
 #include "rl.h"
 #include "gjd.h"
 #include "vdx.h"
+#include "mapped.h"
+
+//
+// GJD archive that pairs with an RL file, e.g. DR.RL -> DR.GJD
+//
+std::string gjdFilenameFor(const std::string& rlFilename)
+{
+    return rlFilename.substr(0, rlFilename.size() - 3) + ".GJD";
+}
+
+//
+// View name of an RL entry, e.g. "f_1bc.VDX" (NUL padded) -> "f_1bc"
+//
+std::string vdxNameFor(const RLEntry& entry)
+{
+    std::string name = entry.filename.substr(0, entry.filename.find_last_of('.'));
+    name.erase(name.find_last_not_of('\0') + 1);
+    return name;
+}
 
 /*
 ===============================================================================
 Function Name: parseGJDFile
 
 Description:
-    - TBD
+    - Parses every VDX file stored in the GJD archive paired with an RL file.
 
 Parameters:
     - rlFilename: the 7th Guest RL file to parse
 
 Return:
-    - TBD
+    - std::vector<VDXFile>: one entry per readable VDX record, in archive order
 
 Notes:
-    - None.
+    - The GJD is memory-mapped and each VDXFile holds views into the mapping,
+    so nothing is copied until a chunk is decoded. If the archive cannot be
+    mapped, each VDX is read into its own buffer instead.
 ===============================================================================
 */
 std::vector<VDXFile> parseGJDFile(const std::string& rlFilename)
 {
-    std::vector<RLEntry> rlEntries = parseRLFile(rlFilename);
+    GJDArchive archive = openGJDArchive(rlFilename);
+    std::vector<VDXFile> GJDData;
+    GJDData.reserve(archive.entries.size());
+
+    for (size_t i = 0; i < archive.entries.size(); ++i) {
+        VDXFile vdxFile;
+        if (archive.readVDX(i, vdxFile))
+            GJDData.push_back(std::move(vdxFile));
+    }
+
+    return GJDData;
+}
+
+/*
+===============================================================================
+Function Name: openGJDArchive
 
-    std::string gjdFilename = rlFilename.substr(0, rlFilename.size() - 3) + ".GJD";
-    std::ifstream gjdFile(gjdFilename, std::ios::binary | std::ios::ate);
+Description:
+    - Loads the cached index of the RL/GJD pair and indexes it by view name
+    without touching any of the VDX data in the GJD.
+
+Parameters:
+    - rlFilename: the 7th Guest RL file to index
+    - required: whether the game cannot go on without this archive
 
-    if (!gjdFile)
+Return:
+    - GJDArchive: index over the RL/GJD pair. If the GJD cannot be opened
+    and the archive is not required, an archive with no entries.
+
+Notes:
+    - A required archive that cannot be opened is reported in a message
+    box and ends the process. Callers on a worker thread must not require
+    theirs.
+    - VDX files are parsed on the first getVDX() call for their name, from
+    the chunk table in the index.
+===============================================================================
+*/
+GJDArchive openGJDArchive(const std::string& rlFilename, bool required)
+{
+    GJDArchive archive;
+    archive.gjdFilename = gjdFilenameFor(rlFilename);
+    archive.gjdIndex = loadGJDIndex(rlFilename);
+    archive.mapping = mapFile(archive.gjdFilename);
+
+    if (!archive.mapping && !std::ifstream(archive.gjdFilename, std::ios::binary))
     {
-        MessageBoxA(NULL, ("Error opening GJD file: " + gjdFilename).c_str(), "Error", MB_OK | MB_ICONERROR);
+        if (!required)
+            return archive;
+
+        MessageBoxA(NULL, ("Error opening GJD file: " + archive.gjdFilename).c_str(), "Error", MB_OK | MB_ICONERROR);
         exit(1);
     }
 
-    std::vector<VDXFile> GJDData;
+    archive.entries.reserve(archive.gjdIndex.entries.size());
+    for (const auto& entry : archive.gjdIndex.entries)
+    {
+        archive.entries.push_back({ std::string(entry.filename, sizeof(entry.filename)), entry.offset, entry.length });
+    }
+
+    archive.index.reserve(archive.entries.size());
+    for (size_t i = 0; i < archive.entries.size(); ++i)
+    {
+        archive.index.emplace(vdxNameFor(archive.entries[i]), i);
+    }
+
+    return archive;
+}
+
+//
+// Look up the RL entry for a view name
+//
+const RLEntry* GJDArchive::find(const std::string& name) const
+{
+    auto it = index.find(name);
+    return it != index.end() ? &entries[it->second] : nullptr;
+}
+
+//
+// Parse (once) and return the VDX file for a view name, or nullptr if the
+// archive does not contain it
+//
+VDXFile* GJDArchive::getVDX(const std::string& name)
+{
+    if (auto it = loaded.find(name); it != loaded.end())
+        return &it->second;
+
+    auto it = index.find(name);
+    if (it == index.end())
+        return nullptr;
+
+    VDXFile vdxFile;
+    if (!readVDX(it->second, vdxFile))
+        return nullptr;
+
+    return &loaded.emplace(name, std::move(vdxFile)).first->second;
+}
+
+/*
+===============================================================================
+Function Name: GJDArchive::readVDX
+
+Description:
+    - Builds the VDXFile for an RL entry from its chunk table in the index.
+    Chunk payloads are views into the mapped GJD, or into a buffer holding
+    just this VDX if the archive could not be mapped.
 
-    for (const auto& entry : rlEntries) {
-        std::vector<uint8_t> vdxData(entry.length);
-        gjdFile.seekg(entry.offset, std::ios::beg);
-        gjdFile.read(reinterpret_cast<char*>(vdxData.data()), entry.length);
+Parameters:
+    - entry: Index into entries
+    - vdxFile: Receives the VDX file
 
-        GJDData.push_back(parseVDXFile(entry.filename, vdxData));
+Return:
+    - bool: false if the entry is not a VDX or lies outside the archive
+===============================================================================
+*/
+bool GJDArchive::readVDX(size_t entry, VDXFile& vdxFile) const
+{
+    if (entry >= gjdIndex.entries.size())
+        return false;
+
+    const GJDIndexEntry& indexEntry = gjdIndex.entries[entry];
+    if (indexEntry.chunkCount == 0)
+        return false;
+
+    std::span<const uint8_t> vdxData;
+
+    if (mapping)
+    {
+        if (size_t(indexEntry.offset) + indexEntry.length > mapping->size)
+            return false;
+
+        vdxData = mapping->data().subspan(indexEntry.offset, indexEntry.length);
+        vdxFile.storage = mapping;
     }
+    else
+    {
+        auto buffer = std::make_shared<std::vector<uint8_t>>(indexEntry.length);
+        std::ifstream gjdFile(gjdFilename, std::ios::binary);
+        gjdFile.seekg(indexEntry.offset, std::ios::beg);
+        if (!gjdFile.read(reinterpret_cast<char*>(buffer->data()), indexEntry.length))
+            return false;
 
-    return GJDData;
+        vdxData = *buffer;
+        vdxFile.storage = std::move(buffer);
+    }
+
+    vdxFile.filename = vdxNameFor(entries[entry]);
+    vdxFile.identifier = indexEntry.identifier;
+    std::copy(std::begin(indexEntry.unknown), std::end(indexEntry.unknown), vdxFile.unknown.begin());
+
+    const auto chunks = gjdIndex.chunksOf(indexEntry);
+    vdxFile.chunks.reserve(chunks.size());
+
+    for (const auto& indexChunk : chunks)
+    {
+        VDXChunk& chunk = vdxFile.chunks.emplace_back();
+        chunk.chunkType = indexChunk.chunkType;
+        chunk.unknown = indexChunk.unknown;
+        chunk.dataSize = indexChunk.dataSize;
+        chunk.lengthMask = indexChunk.lengthMask;
+        chunk.lengthBits = indexChunk.lengthBits;
+
+        const size_t offset = std::min<size_t>(indexChunk.offset, vdxData.size());
+        chunk.raw = vdxData.subspan(offset, std::min<size_t>(indexChunk.dataSize, vdxData.size() - offset));
+    }
+
+    return true;
 }
\ No newline at end of file
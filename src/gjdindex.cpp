@@ -0,0 +1,219 @@
+// gjdindex.cpp
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "gjdindex.h"
+#include "gjd.h"
+#include "rl.h"
+#include "vdx.h"
+#include "mapped.h"
+
+namespace
+{
+    constexpr char INDEX_MAGIC[4] = { '7', 'G', 'I', 'X' };
+    constexpr uint32_t INDEX_VERSION = 1;
+
+    // Size and modification time of a file, zero if it does not exist
+    void stampFile(const std::string& filename, uint64_t& size, int64_t& time)
+    {
+        std::error_code error;
+        size = std::filesystem::file_size(filename, error);
+        if (error)
+            size = 0;
+
+        const auto writeTime = std::filesystem::last_write_time(filename, error);
+        time = error ? 0 : static_cast<int64_t>(writeTime.time_since_epoch().count());
+    }
+
+    bool isVDXEntry(const RLEntry& entry)
+    {
+        std::string extension = entry.filename.substr(entry.filename.find_last_of('.') + 1);
+        extension.erase(extension.find_last_not_of('\0') + 1);
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast<char>(std::toupper(c)); });
+        return extension == "VDX";
+    }
+
+    // Point a GJDIndex into serialized index bytes; false if they are not a usable index
+    bool viewIndex(std::span<const uint8_t> bytes, const GJDIndexHeader& expected, GJDIndex& index)
+    {
+        if (bytes.size() < sizeof(GJDIndexHeader))
+            return false;
+
+        GJDIndexHeader header;
+        std::memcpy(&header, bytes.data(), sizeof(header));
+
+        if (std::memcmp(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0 || header.version != INDEX_VERSION ||
+            header.rlSize != expected.rlSize || header.rlTime != expected.rlTime ||
+            header.gjdSize != expected.gjdSize || header.gjdTime != expected.gjdTime)
+            return false;
+
+        const size_t entriesBytes = size_t(header.entryCount) * sizeof(GJDIndexEntry);
+        const size_t chunksBytes = size_t(header.chunkCount) * sizeof(GJDIndexChunk);
+        if (bytes.size() != sizeof(GJDIndexHeader) + entriesBytes + chunksBytes)
+            return false;
+
+        index.entries = { reinterpret_cast<const GJDIndexEntry*>(bytes.data() + sizeof(GJDIndexHeader)), header.entryCount };
+        index.chunks = { reinterpret_cast<const GJDIndexChunk*>(bytes.data() + sizeof(GJDIndexHeader) + entriesBytes), header.chunkCount };
+
+        for (const auto& entry : index.entries)
+        {
+            if (size_t(entry.firstChunk) + entry.chunkCount > header.chunkCount)
+                return false;
+        }
+
+        return true;
+    }
+
+    // Walk the RL records and the chunk headers of every VDX in the GJD
+    std::vector<uint8_t> buildIndex(const std::string& rlFilename, const GJDIndexHeader& header)
+    {
+        const std::vector<RLEntry> rlEntries = parseRLFile(rlFilename);
+        const std::string gjdFilename = gjdFilenameFor(rlFilename);
+        const auto archive = mapFile(gjdFilename);
+        std::ifstream gjdFile;
+        if (!archive)
+            gjdFile.open(gjdFilename, std::ios::binary);
+
+        std::vector<GJDIndexEntry> entries;
+        std::vector<GJDIndexChunk> chunks;
+        entries.reserve(rlEntries.size());
+
+        for (const auto& rlEntry : rlEntries)
+        {
+            GJDIndexEntry& entry = entries.emplace_back();
+            std::memset(&entry, 0, sizeof(entry));
+            std::memcpy(entry.filename, rlEntry.filename.data(), std::min(rlEntry.filename.size(), sizeof(entry.filename)));
+            entry.offset = static_cast<uint32_t>(rlEntry.offset);
+            entry.length = static_cast<uint32_t>(rlEntry.length);
+            entry.firstChunk = static_cast<uint32_t>(chunks.size());
+
+            if (!isVDXEntry(rlEntry) || rlEntry.length < 8)
+                continue;
+
+            std::vector<uint8_t> vdxData;
+            std::span<const uint8_t> vdxView;
+
+            if (archive)
+            {
+                if (rlEntry.offset + rlEntry.length > archive->size)
+                    continue;
+                vdxView = archive->data().subspan(rlEntry.offset, rlEntry.length);
+            }
+            else
+            {
+                vdxData.resize(rlEntry.length);
+                gjdFile.seekg(rlEntry.offset, std::ios::beg);
+                if (!gjdFile.read(reinterpret_cast<char*>(vdxData.data()), rlEntry.length))
+                {
+                    gjdFile.clear();
+                    continue;
+                }
+                vdxView = vdxData;
+            }
+
+            const VDXFile vdxFile = parseVDXFile(rlEntry.filename, vdxView, nullptr);
+            entry.identifier = vdxFile.identifier;
+            std::copy(vdxFile.unknown.begin(), vdxFile.unknown.end(), entry.unknown);
+
+            for (const auto& chunk : vdxFile.chunks)
+            {
+                chunks.push_back({ chunk.chunkType, chunk.unknown, chunk.lengthMask, chunk.lengthBits, chunk.dataSize,
+                    static_cast<uint32_t>(chunk.raw.data() - vdxView.data()) });
+            }
+            entry.chunkCount = static_cast<uint32_t>(chunks.size() - entry.firstChunk);
+        }
+
+        GJDIndexHeader finalHeader = header;
+        finalHeader.entryCount = static_cast<uint32_t>(entries.size());
+        finalHeader.chunkCount = static_cast<uint32_t>(chunks.size());
+
+        std::vector<uint8_t> bytes(sizeof(GJDIndexHeader) + entries.size() * sizeof(GJDIndexEntry) + chunks.size() * sizeof(GJDIndexChunk));
+        uint8_t* out = bytes.data();
+        std::memcpy(out, &finalHeader, sizeof(finalHeader));
+        out += sizeof(finalHeader);
+        if (!entries.empty())
+            std::memcpy(out, entries.data(), entries.size() * sizeof(GJDIndexEntry));
+        out += entries.size() * sizeof(GJDIndexEntry);
+        if (!chunks.empty())
+            std::memcpy(out, chunks.data(), chunks.size() * sizeof(GJDIndexChunk));
+
+        return bytes;
+    }
+}
+
+//
+// Index file that pairs with an RL file, e.g. DR.RL -> DR.IDX
+//
+std::string indexFilenameFor(const std::string& rlFilename)
+{
+    return rlFilename.substr(0, rlFilename.size() - 3) + ".IDX";
+}
+
+/*
+===============================================================================
+Function Name: loadGJDIndex
+
+Description:
+    - Maps the cached index for an RL/GJD pair, rebuilding and rewriting it
+    first if it is missing, corrupt or older than either file.
+
+Parameters:
+    - rlFilename: the 7th Guest RL file to index
+
+Return:
+    - GJDIndex: RL records and VDX chunk tables. Empty if the RL file could
+    not be read.
+
+Notes:
+    - The index is written to a temporary file and renamed into place, so
+    an interrupted write never leaves a half-written index behind.
+===============================================================================
+*/
+GJDIndex loadGJDIndex(const std::string& rlFilename)
+{
+    GJDIndexHeader header{};
+    std::memcpy(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    header.version = INDEX_VERSION;
+    stampFile(rlFilename, header.rlSize, header.rlTime);
+    stampFile(gjdFilenameFor(rlFilename), header.gjdSize, header.gjdTime);
+
+    const std::string indexFilename = indexFilenameFor(rlFilename);
+    GJDIndex index;
+
+    if (auto mapping = mapFile(indexFilename); mapping && viewIndex(mapping->data(), header, index))
+    {
+        index.storage = std::move(mapping);
+        return index;
+    }
+
+    auto bytes = std::make_shared<const std::vector<uint8_t>>(buildIndex(rlFilename, header));
+    viewIndex(*bytes, header, index);
+    index.storage = bytes;
+
+    // Only cache an index of an RL file that could actually be read
+    if (header.rlSize == 0)
+        return index;
+
+    const std::string tempFilename = indexFilename + ".tmp";
+    bool written = false;
+    {
+        std::ofstream indexFile(tempFilename, std::ios::binary | std::ios::trunc);
+        indexFile.write(reinterpret_cast<const char*>(bytes->data()), bytes->size());
+        written = static_cast<bool>(indexFile);
+    }
+
+    // A read-only game directory just means the index is rebuilt next time
+    std::error_code error;
+    if (written)
+        std::filesystem::rename(tempFilename, indexFilename, error);
+    if (!written || error)
+        std::filesystem::remove(tempFilename, error);
+
+    return index;
+}
\ No newline at end of file
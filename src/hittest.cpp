@@ -0,0 +1,112 @@
+// hittest.cpp
+
+#include <algorithm>
+#include <cmath>
+
+#include "hittest.h"
+#include "game.h"
+
+//
+// Inclusive containment test, in percent of the client area
+//
+static bool contains(const Hotspot& rect, float percentX, float percentY)
+{
+	return percentX >= rect.x && percentX <= rect.x + rect.width &&
+		percentY >= rect.y && percentY <= rect.y + rect.height;
+}
+
+//
+// Grid cell range covered by [start, start + length] percent along one axis
+//
+static std::pair<int, int> cellSpan(float start, float length, int cells)
+{
+	const int first = static_cast<int>(std::floor(start * cells / 100.0f));
+	const int last = static_cast<int>(std::floor((start + length) * cells / 100.0f));
+
+	return { std::clamp(first, 0, cells - 1), std::clamp(last, 0, cells - 1) };
+}
+
+/*
+===============================================================================
+Function Name: HitGrid::build
+
+Description:
+	- Buckets every navigation and hotspot rectangle of view into the grid
+	cells it overlaps. Called from loadView() whenever the view changes.
+
+Parameters:
+	- view: View to index. Must stay alive, unmodified, until the next
+	build(); query() returns pointers into it.
+===============================================================================
+*/
+void HitGrid::build(const View& newView)
+{
+	view = &newView;
+
+	std::vector<const Hotspot*> rects;
+	rects.reserve(newView.navigations.size() + newView.hotspots.size());
+	for (const auto& nav : newView.navigations)
+		rects.push_back(&nav.hotspot);
+	for (const auto& hotspot : newView.hotspots)
+		rects.push_back(&hotspot);
+
+	// Count per cell, prefix-sum into offsets, then fill; entries stay in priority order
+	std::array<uint32_t, columns * rows> counts{};
+	auto forEachCell = [&](const Hotspot& rect, auto&& visit) {
+		const auto [x0, x1] = cellSpan(rect.x, rect.width, columns);
+		const auto [y0, y1] = cellSpan(rect.y, rect.height, rows);
+		for (int y = y0; y <= y1; ++y)
+			for (int x = x0; x <= x1; ++x)
+				visit(y * columns + x);
+	};
+
+	for (const Hotspot* rect : rects)
+		forEachCell(*rect, [&](int cell) { ++counts[cell]; });
+
+	offsets[0] = 0;
+	for (size_t cell = 0; cell < counts.size(); ++cell)
+		offsets[cell + 1] = offsets[cell] + counts[cell];
+
+	entries.resize(offsets.back());
+
+	std::array<uint32_t, columns * rows> cursor;
+	std::copy(offsets.begin(), offsets.end() - 1, cursor.begin());
+
+	for (size_t i = 0; i < rects.size(); ++i)
+		forEachCell(*rects[i], [&](int cell) { entries[cursor[cell]++] = static_cast<uint16_t>(i); });
+}
+
+//
+// Rectangle under a point given in percent of the client area
+//
+HitTarget HitGrid::query(float percentX, float percentY) const
+{
+	if (!view || percentX < 0.0f || percentX > 100.0f || percentY < 0.0f || percentY > 100.0f)
+		return {};
+
+	const int cellX = std::min(static_cast<int>(percentX * columns / 100.0f), columns - 1);
+	const int cellY = std::min(static_cast<int>(percentY * rows / 100.0f), rows - 1);
+	const int cell = cellY * columns + cellX;
+
+	const size_t navigationCount = view->navigations.size();
+
+	for (uint32_t i = offsets[cell]; i < offsets[cell + 1]; ++i)
+	{
+		const size_t entry = entries[i];
+
+		if (entry < navigationCount)
+		{
+			const Navigation& nav = view->navigations[entry];
+			if (contains(nav.hotspot, percentX, percentY))
+				return { .navigation = &nav };
+		}
+		else
+		{
+			const Hotspot& hotspot = view->hotspots[entry - navigationCount];
+			if (contains(hotspot, percentX, percentY))
+				return { .hotspot = &hotspot };
+		}
+	}
+
+	return {};
+}
@@ -1,84 +1,240 @@
 #include <vector>
 #include <iostream>
+#include <algorithm>
+#include <cstring>
 
 #include "lzss.h"
 
-//
-// LZSS Compression
-//
-std::vector<uint8_t> lzssCompress(const std::vector<uint8_t>& inputData, uint8_t lengthMask, uint8_t lengthBits)
+namespace
 {
-	const uint16_t N = 1 << (16 - lengthBits);
-	const uint16_t F = 1 << lengthBits;
-	const int threshold = 3;
+	constexpr int threshold = 3;
+	constexpr size_t hashBits = 15;
+	constexpr size_t hashSize = size_t{ 1 } << hashBits;
 
-	std::vector<uint8_t> compressedData;
-	std::vector<uint8_t> his_buf(N, 0);
-	int32_t his_buf_pos = N - F;
-	int32_t pos = 0;
+	struct LZSSMatch
+	{
+		uint16_t length;
+		uint16_t distance;
+	};
 
-	while (pos < static_cast<int32_t>(inputData.size()))
+	//
+	// Hash-chain match finder
+	//
+	// The decoder's history buffer starts out as N zero bytes with the write
+	// position at N - F, so the history seen by any back-reference is exactly
+	// the last N bytes of "N zeros followed by the input". Matching against
+	// that linear stream (instead of a copy of his_buf) also gets overlapping
+	// matches right, because the bytes a long match reads past the write
+	// position are the ones it is about to produce.
+	//
+	class MatchFinder
 	{
-		uint8_t flags = 0;
-		size_t flags_pos = compressedData.size();
-		compressedData.push_back(0);
+	public:
+		MatchFinder(const std::vector<uint8_t>& inputData, size_t N, size_t maxLength, size_t maxChain)
+			: N(N), maxLength(maxLength), maxChain(maxChain),
+			stream(N + inputData.size(), 0), head(hashSize, -1), prev(N, -1)
+		{
+			std::copy(inputData.begin(), inputData.end(), stream.begin() + N);
 
-		for (int i = 0; i < 8 && pos < static_cast<int32_t>(inputData.size()); ++i)
+			// Only the tail of the zero prefix is worth indexing: a match that
+			// starts earlier is all zeros and no longer than one starting here
+			for (size_t pos = (N > maxLength ? N - maxLength : 1); pos < N; ++pos)
+				insert(pos);
+		}
+
+		// Longest match for the input byte at stream position pos (pos >= N)
+		LZSSMatch find(size_t pos) const
 		{
-			int max_match_length = 0;
-			int match_offset = 0;
+			LZSSMatch best{ 0, 0 };
+			const size_t available = std::min(maxLength, stream.size() - pos);
+
+			if (available < threshold)
+				return best;
+
+			const uint8_t* current = stream.data() + pos;
+			int32_t candidate = head[hash(pos)];
 
-			for (int j = 1; j <= N; ++j)
+			for (size_t chain = 0; candidate >= 0 && chain < maxChain; ++chain)
 			{
-				int k = (his_buf_pos - j + N) % N;
-				int match_length = 0;
+				const size_t distance = pos - candidate;
 
-				while (match_length < F && pos + match_length < static_cast<int32_t>(inputData.size()) &&
-					his_buf[(k + match_length) % N] == inputData[pos + match_length])
-				{
-					++match_length;
-				}
+				// Distance N would be encoded as 0, which collides with the end marker
+				if (distance >= N)
+					break;
 
-				if (match_length > max_match_length)
+				const uint8_t* history = stream.data() + candidate;
+				if (history[best.length] == current[best.length])
 				{
-					max_match_length = match_length;
-					match_offset = (his_buf_pos - k) & (N - 1);
+					size_t length = 0;
+					while (length < available && history[length] == current[length])
+						++length;
+
+					if (length > best.length)
+					{
+						best = { static_cast<uint16_t>(length), static_cast<uint16_t>(distance) };
+						if (length == available)
+							break;
+					}
 				}
 
-				if (max_match_length == F)
-					break;
+				candidate = prev[candidate & (N - 1)];
 			}
 
-			if (max_match_length >= threshold)
+			return best.length >= threshold ? best : LZSSMatch{ 0, 0 };
+		}
+
+		void insert(size_t pos)
+		{
+			if (pos + threshold > stream.size())
+				return;
+
+			const size_t h = hash(pos);
+			prev[pos & (N - 1)] = head[h];
+			head[h] = static_cast<int32_t>(pos);
+		}
+
+	private:
+		size_t hash(size_t pos) const
+		{
+			return ((stream[pos] << 10) ^ (stream[pos + 1] << 5) ^ stream[pos + 2]) & (hashSize - 1);
+		}
+
+		const size_t N;
+		const size_t maxLength;
+		const size_t maxChain;
+		std::vector<uint8_t> stream;
+		std::vector<int32_t> head;
+		std::vector<int32_t> prev;
+	};
+
+	//
+	// Packs literals and back-references into flag-prefixed groups of eight
+	//
+	class LZSSWriter
+	{
+	public:
+		LZSSWriter(std::vector<uint8_t>& out, uint8_t lengthBits) : out(out), lengthBits(lengthBits) {}
+
+		void literal(uint8_t b)
+		{
+			beginItem();
+			out[flagsPos] |= static_cast<uint8_t>(1 << item);
+			out.push_back(b);
+			++item;
+		}
+
+		void match(const LZSSMatch& m)
+		{
+			beginItem();
+			const uint16_t ofs_len = static_cast<uint16_t>((m.distance << lengthBits) | (m.length - threshold));
+			out.push_back(ofs_len & 0xFF);
+			out.push_back((ofs_len >> 8) & 0xFF);
+			++item;
+		}
+
+		void finish()
+		{
+			out.push_back(0);
+			out.push_back(0);
+		}
+
+	private:
+		void beginItem()
+		{
+			if (item == 8)
 			{
-				uint16_t length = max_match_length - threshold;
-				uint16_t ofs_len = (match_offset << lengthBits) | length;
-				compressedData.push_back(ofs_len & 0xFF);
-				compressedData.push_back((ofs_len >> 8) & 0xFF);
-				flags |= (0 << i);
+				flagsPos = out.size();
+				out.push_back(0);
+				item = 0;
+			}
+		}
+
+		std::vector<uint8_t>& out;
+		const uint8_t lengthBits;
+		size_t flagsPos = 0;
+		int item = 8;
+	};
+}
+
+//
+// LZSS Compression
+//
+// Fast takes the longest match from a short hash chain at every position.
+// Optimal searches the whole window and then picks the cheapest parse of the
+// entire input (9 bits per literal, 17 bits per back-reference).
+//
+std::vector<uint8_t> lzssCompress(const std::vector<uint8_t>& inputData, uint8_t lengthMask, uint8_t lengthBits, LZSSLevel level)
+{
+	const size_t N = size_t{ 1 } << (16 - lengthBits);
+	const size_t F = size_t{ 1 } << lengthBits;
+	const size_t maxLength = std::min<size_t>(lengthMask, F - 1) + threshold;
+	const size_t maxChain = level == LZSSLevel::Fast ? 16 : N;
+
+	std::vector<uint8_t> compressedData;
+	compressedData.reserve(inputData.size() + inputData.size() / 8 + 3);
+
+	MatchFinder finder(inputData, N, maxLength, maxChain);
+	LZSSWriter writer(compressedData, lengthBits);
+	const size_t size = inputData.size();
+
+	if (level == LZSSLevel::Fast)
+	{
+		size_t pos = 0;
+		while (pos < size)
+		{
+			const LZSSMatch m = finder.find(N + pos);
+			const size_t advance = m.length ? m.length : 1;
+
+			if (m.length)
+				writer.match(m);
+			else
+				writer.literal(inputData[pos]);
 
-				for (int j = 0; j < max_match_length; ++j)
+			for (size_t i = 0; i < advance; ++i)
+				finder.insert(N + pos + i);
+			pos += advance;
+		}
+	}
+	else
+	{
+		std::vector<LZSSMatch> matches(size);
+		for (size_t pos = 0; pos < size; ++pos)
+		{
+			matches[pos] = finder.find(N + pos);
+			finder.insert(N + pos);
+		}
+
+		// cost[pos] = fewest bits needed to encode inputData[pos..]
+		std::vector<uint32_t> cost(size + 1, 0);
+		std::vector<uint16_t> choice(size, 0);
+		for (size_t pos = size; pos-- > 0;)
+		{
+			cost[pos] = cost[pos + 1] + 9;
+			for (size_t length = threshold; length <= matches[pos].length; ++length)
+			{
+				if (cost[pos + length] + 17 < cost[pos])
 				{
-					his_buf[his_buf_pos] = inputData[pos];
-					his_buf_pos = (his_buf_pos + 1) % N;
-					++pos;
+					cost[pos] = cost[pos + length] + 17;
+					choice[pos] = static_cast<uint16_t>(length);
 				}
 			}
+		}
+
+		for (size_t pos = 0; pos < size;)
+		{
+			if (choice[pos])
+			{
+				writer.match({ choice[pos], matches[pos].distance });
+				pos += choice[pos];
+			}
 			else
 			{
-				uint8_t b = inputData[pos++];
-				compressedData.push_back(b);
-				his_buf[his_buf_pos] = b;
-				his_buf_pos = (his_buf_pos + 1) % N;
-				flags |= (1 << i);
+				writer.literal(inputData[pos++]);
 			}
 		}
-
-		compressedData[flags_pos] = flags;
 	}
 
-	compressedData.push_back(0);
-	compressedData.push_back(0);
+	writer.finish();
 
 	return compressedData;
 }
@@ -86,13 +242,14 @@ std::vector<uint8_t> lzssCompress(const std::vector<uint8_t>& inputData, uint8_t
 //
 // LZSS Decompression
 //
-std::vector<uint8_t> lzssDecompress(const std::vector<uint8_t>& compressedData, uint8_t lengthMask, uint8_t lengthBits)
+std::vector<uint8_t> lzssDecompress(std::span<const uint8_t> compressedData, uint8_t lengthMask, uint8_t lengthBits)
 {
-	const uint16_t N = 1 << (16 - lengthBits);
-	const uint16_t F = 1 << lengthBits;
-	const uint8_t threshold = 3;
+	const size_t N = size_t{ 1 } << (16 - lengthBits);
+	const size_t F = size_t{ 1 } << lengthBits;
+	const size_t mask = N - 1;
 
 	std::vector<uint8_t> decompressedData;
+	decompressedData.reserve(compressedData.size() * 4);
 	std::vector<uint8_t> his_buf(N);
 	size_t his_buf_pos = N - F;
 	size_t in_buf_pos = 0;
@@ -108,30 +265,110 @@ std::vector<uint8_t> lzssDecompress(const std::vector<uint8_t>& compressedData,
 				uint8_t b = compressedData[in_buf_pos++];
 				decompressedData.push_back(b);
 				his_buf[his_buf_pos] = b;
-				his_buf_pos = (his_buf_pos + 1) % N;
+				his_buf_pos = (his_buf_pos + 1) & mask;
 			}
 			else
 			{
 				if (in_buf_pos + 1 >= compressedData.size())
 					break;
 
-				uint16_t ofs_len = compressedData[in_buf_pos++] | (compressedData[in_buf_pos++] << 8);
+				uint16_t ofs_len = compressedData[in_buf_pos] | (compressedData[in_buf_pos + 1] << 8);
+				in_buf_pos += 2;
 				if (ofs_len == 0)
 					return decompressedData;
 
-				uint16_t offset = (his_buf_pos - (ofs_len >> lengthBits)) % N;
+				size_t offset = (his_buf_pos - (ofs_len >> lengthBits)) & mask;
 				uint16_t length = (ofs_len & lengthMask) + threshold;
 
 				for (uint16_t j = 0; j < length; ++j)
 				{
-					uint8_t b = his_buf[(offset + j) % N];
+					uint8_t b = his_buf[(offset + j) & mask];
 					decompressedData.push_back(b);
 					his_buf[his_buf_pos] = b;
-					his_buf_pos = (his_buf_pos + 1) % N;
+					his_buf_pos = (his_buf_pos + 1) & mask;
 				}
 			}
 		}
 	}
 
 	return decompressedData;
+}
+
+//
+// LZSS Decompression into a caller-provided buffer
+//
+// The output itself serves as the history: a back-reference of distance d
+// reads d bytes behind the write position, and anything before the start of
+// the output is the decoder's zero-initialized his_buf. A distance of 0 wraps
+// all the way around the N-byte window. Decoding stops once the output is
+// full; the number of bytes written is returned.
+//
+size_t lzssDecompress(std::span<const uint8_t> compressedData, uint8_t lengthMask, uint8_t lengthBits, std::span<uint8_t> output)
+{
+	const size_t N = size_t{ 1 } << (16 - lengthBits);
+	const uint8_t* in = compressedData.data();
+	const size_t inSize = compressedData.size();
+	uint8_t* out = output.data();
+	const size_t capacity = output.size();
+
+	size_t inPos = 0;
+	size_t outPos = 0;
+
+	while (inPos < inSize)
+	{
+		uint8_t flags = in[inPos++];
+
+		for (int i = 0; i < 8 && inPos < inSize; ++i, flags >>= 1)
+		{
+			if (flags & 1)
+			{
+				if (outPos == capacity)
+					return outPos;
+
+				out[outPos++] = in[inPos++];
+				continue;
+			}
+
+			if (inPos + 1 >= inSize)
+				return outPos;
+
+			const uint16_t ofs_len = in[inPos] | (in[inPos + 1] << 8);
+			inPos += 2;
+			if (ofs_len == 0)
+				return outPos;
+
+			const size_t distance = (ofs_len >> lengthBits) ? (ofs_len >> lengthBits) : N;
+			size_t length = std::min<size_t>((ofs_len & lengthMask) + threshold, capacity - outPos);
+
+			if (distance > outPos)
+			{
+				const size_t zeros = std::min(length, distance - outPos);
+				std::memset(out + outPos, 0, zeros);
+				outPos += zeros;
+				length -= zeros;
+			}
+
+			if (length > 0)
+			{
+				// Non-overlapping references are a straight copy; overlapping
+				// ones repeat the last distance bytes and must go byte by byte
+				const uint8_t* src = out + outPos - distance;
+				if (distance >= length)
+				{
+					std::memcpy(out + outPos, src, length);
+				}
+				else
+				{
+					for (size_t j = 0; j < length; ++j)
+						out[outPos + j] = src[j];
+				}
+				outPos += length;
+			}
+
+			if (outPos == capacity)
+				return outPos;
+		}
+	}
+
+	return outPos;
 }
\ No newline at end of file
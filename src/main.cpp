@@ -42,6 +42,7 @@
 #include <memory>
 #include <filesystem>
 #include <algorithm>
+#include <cctype>
 
 #include "config.h"
 #include "game.h"
@@ -51,6 +52,7 @@
 #include "gjd.h"
 #include "vdx.h"
 #include "xmi.h"
+#include "bench.h"
 
  //
  // Working around Microsoft Shittiness (FreeConsole() doesn't work)
@@ -122,7 +124,7 @@ int WINAPI WinMain(
 			//
 			else if (args[1] == "-l") {
 				if (args.size() < 3) {
-					MessageBoxA(NULL, "ERROR: a *.vdx file was not specified.\n\nExample: v64tng.exe -l f_1bc.vdx", "v64tng.exe", MB_OK | MB_ICONERROR);
+					MessageBoxA(NULL, "ERROR: a *.vdx file was not specified.\n\nExample: v64tng.exe -l f_1bc.vdx {fast}", "v64tng.exe", MB_OK | MB_ICONERROR);
 					return 1;
 				}
 
@@ -142,13 +144,13 @@ int WINAPI WinMain(
 					return 1;
 				}
 
-				vdxFile = parseVDXFile(args[2], buffer);
+				vdxFile = parseVDXFile(args[2], std::move(buffer));
 
 				// Get the last chunk
 				auto& chunk = vdxFile.chunks.back();
 
 				// Extract only the chunk data (excluding the chunk header)
-				const std::vector<uint8_t>& chunkData = chunk.data;
+				std::span<const uint8_t> chunkData = chunk.raw;
 
 				// Save the original compressed data (excluding the chunk header)
 				std::ofstream chunkFile(args[2].substr(0, args[2].find_last_of('.')) + "_chunk_original.bin", std::ios::binary);
@@ -162,7 +164,8 @@ int WINAPI WinMain(
 				decompFile.close();
 
 				// Compress the decompressed data
-				auto compressedData = lzssCompress(decompressedData, chunk.lengthMask, chunk.lengthBits);
+				LZSSLevel level = (args.size() > 3 && args[3] == "fast") ? LZSSLevel::Fast : LZSSLevel::Optimal;
+				auto compressedData = lzssCompress(decompressedData, chunk.lengthMask, chunk.lengthBits, level);
 				std::ofstream compFile(args[2].substr(0, args[2].find_last_of('.')) + "_chunk_compressed.bin", std::ios::binary);
 				compFile.write(reinterpret_cast<const char*>(compressedData.data()), compressedData.size());
 				compFile.close();
@@ -172,18 +175,29 @@ int WINAPI WinMain(
 			//
 			else if (args[1] == "-p") {
 				if (args.size() < 3) {
-					std::cerr << "ERROR: a *.VDX file was not specified.\n\nExample: v64tng.exe -p f_1bb.vdx {raw} {alpha} {video}" << std::endl;
+					std::cerr << "ERROR: a *.VDX file was not specified.\n\nExample: v64tng.exe -p f_1bb.vdx {raw} {alpha} {video} {fast|small} {indexed}\n         v64tng.exe -p FH.RL {raw} {fast|small} {indexed}\n         v64tng.exe -p <directory> {raw} {fast|small} {indexed}" << std::endl;
 					simulateEnterKey();
 					return 1;
 				}
 
 				bool raw = false;
 				bool video = false;
+				bool indexed = false;
+				PNGOptions pngOptions;
 
 				for (auto arg = args.begin() + 3; arg != args.end(); ++arg) {
 					if (*arg == "raw") {
 						raw = true;
 					}
+					else if (*arg == "fast") {
+						pngOptions = PNGOptions::fast();
+					}
+					else if (*arg == "small") {
+						pngOptions = PNGOptions::smallest();
+					}
+					else if (*arg == "indexed") {
+						indexed = true;
+					}
 					else if (*arg == "alpha") {
 						config["devMode"] = true;
 					}
@@ -191,29 +205,27 @@ int WINAPI WinMain(
 						video = true;
 					}
 				}
-				extractPNG(args[2], raw);
+				pngOptions.indexed = indexed;
 
-				std::string fullPath = args[2];
-				std::string directory;
-				std::string filename;
-				size_t lastSlashPos = fullPath.find_last_of("\\/");
+				// Whole archives and directories go through the parallel batch extractor
+				std::filesystem::path inputPath(args[2]);
+				std::string extension = inputPath.extension().string();
+				std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
 
-				if (lastSlashPos != std::string::npos) {
-					directory = fullPath.substr(0, lastSlashPos);
-					filename = fullPath.substr(lastSlashPos + 1);
-				}
-				else {
-					filename = fullPath;
+				if (std::filesystem::is_directory(inputPath) || extension == ".rl") {
+					extractPNGBatch(args[2], raw, pngOptions);
+					simulateEnterKey();
+					return 0;
 				}
 
-				size_t lastDotPos = filename.find_last_of('.');
-				if (lastDotPos != std::string::npos) {
-					filename[lastDotPos] = '_';
+				// Frames are streamed straight into FFmpeg, no PNGs are written
+				if (video) {
+					exportVideo(args[2]);
+					simulateEnterKey();
+					return 0;
 				}
 
-				if (video && !raw) {
-					createVideoFromImages(directory.empty() ? filename : directory + "\\" + filename);
-				}
+				extractPNG(args[2], raw, pngOptions);
 
 				simulateEnterKey();
 			}
@@ -239,20 +251,14 @@ int WINAPI WinMain(
 					return 1;
 				}
 
-				auto xmiFiles = parseRLFile("XMI.RL");
-				for (auto& entry : xmiFiles) {
-					entry.filename.erase(entry.filename.find_last_of('.'));
-				}
-
-				auto song = std::find_if(xmiFiles.begin(), xmiFiles.end(),
-					[&](const RLEntry& entry) { return entry.filename == args[2]; });
+				const RLEntry* song = xmiArchive().find(args[2]);
 
-				if (song != xmiFiles.end()) {
+				if (song) {
 					if (args.size() > 3 && args[3] == "play") {
 						PlayMIDI(xmiConverter(*song));
 					}
 					else {
-						extractXMI(xmiConverter(*song), song->filename);
+						extractXMI(xmiConverter(*song), args[2]);
 					}
 				}
 				else {
@@ -261,9 +267,35 @@ int WINAPI WinMain(
 					return 1;
 				}
 			}
+			//
+			// Benchmark the codecs and renderers over every VDX file of a *.RL/GJD file pair
+			//
+			else if (args[1] == "-bench") {
+				if (args.size() < 3) {
+					std::cerr << "ERROR: a *.RL file was not specified.\n\nExample: v64tng.exe -bench DR.RL {norender} {out=bench.json}" << std::endl;
+					simulateEnterKey();
+					return 1;
+				}
+
+				BenchOptions options;
+				for (size_t i = 3; i < args.size(); ++i) {
+					if (args[i] == "norender") {
+						options.render = false;
+					}
+					else if (args[i].rfind("out=", 0) == 0) {
+						options.output = args[i].substr(4);
+					}
+				}
+
+				if (runBenchmarks(args[2], options) != 0) {
+					simulateEnterKey();
+					return 1;
+				}
+				simulateEnterKey();
+			}
 			else {
 				std::cerr << "ERROR: Invalid option: " << args[1] << std::endl;
-				std::cerr << "\nUsage: " << args[0] << " [-r|-p|-g|-x] file" << std::endl;
+				std::cerr << "\nUsage: " << args[0] << " [-r|-p|-g|-x|-bench] file" << std::endl;
 				simulateEnterKey();
 				return 1;
 			}
@@ -0,0 +1,61 @@
+// mapped.cpp
+
+#include <windows.h>
+#include <memory>
+#include <string>
+
+#include "mapped.h"
+
+//
+// Release the view and both handles
+//
+MappedFile::~MappedFile()
+{
+	if (view) UnmapViewOfFile(view);
+	if (mapping) CloseHandle(mapping);
+	if (file) CloseHandle(file);
+}
+
+/*
+===============================================================================
+Function Name: mapFile
+
+Description:
+	- Maps an entire file into memory for reading.
+
+Parameters:
+	- filename: Path of the file to map.
+
+Return:
+	- The mapping, or nullptr if the file could not be opened or mapped.
+
+Notes:
+	- The mapping stays alive for as long as any VDXFile holds a view into it.
+===============================================================================
+*/
+std::shared_ptr<const MappedFile> mapFile(const std::string& filename)
+{
+	auto mapped = std::make_shared<MappedFile>();
+
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return nullptr;
+	mapped->file = file;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+		return nullptr;
+
+	mapped->mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mapped->mapping)
+		return nullptr;
+
+	mapped->view = static_cast<const uint8_t*>(MapViewOfFile(mapped->mapping, FILE_MAP_READ, 0, 0, 0));
+	if (!mapped->view)
+		return nullptr;
+
+	mapped->size = static_cast<size_t>(fileSize.QuadPart);
+
+	return mapped;
+}
\ No newline at end of file
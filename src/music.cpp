@@ -0,0 +1,520 @@
+// music.cpp
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+#include <windows.h>
+#include <mmsystem.h>
+
+#include "music.h"
+#include "gjd.h"
+#include "xmi.h"
+
+namespace
+{
+	constexpr uint32_t DEFAULT_TEMPO = 500000;		// Microseconds per quarter note until a tempo event
+	constexpr int64_t BLOCK_MICROSECONDS = 250000;	// Music queued per block, at most
+	constexpr uint8_t DEFAULT_CHANNEL_VOLUME = 100;	// General MIDI power-on CC 7
+
+	uint32_t readBE32(const uint8_t* data)
+	{
+		return (uint32_t(data[0]) << 24) | (uint32_t(data[1]) << 16) | (uint32_t(data[2]) << 8) | data[3];
+	}
+
+	// Variable-length quantity at track[i]; advances i past it
+	uint32_t readVarLen(std::span<const uint8_t> track, size_t& i)
+	{
+		uint32_t value = 0;
+		while (i < track.size())
+		{
+			const uint8_t byte = track[i++];
+			value = (value << 7) | (byte & 0x7F);
+			if (!(byte & 0x80))
+				break;
+		}
+		return value;
+	}
+
+	bool isVolumeChange(uint32_t event)
+	{
+		return MEVT_EVENTTYPE(event) == MEVT_SHORTMSG && (event & 0xF0) == 0xB0 && ((event >> 8) & 0xFF) == 7;
+	}
+}
+
+/*
+===============================================================================
+Function Name: parseMidiSequence
+
+Description:
+	- Flattens the first track of a standard MIDI file (as produced by
+	xmiConverter) into stream events: channel messages become short
+	MIDIEVENTs, Set Tempo becomes MEVT_TEMPO, and every other meta or
+	SysEx event is dropped with its delta carried over to the next event.
+
+Parameters:
+	- midiData: Standard MIDI file data
+
+Return:
+	- MidiSequence: Events ready for midiStreamOut
+
+Notes:
+	- Throws std::runtime_error if the data is not a MIDI file or uses SMPTE
+	time division.
+===============================================================================
+*/
+MidiSequence parseMidiSequence(std::span<const uint8_t> midiData)
+{
+	if (midiData.size() < 14 || std::memcmp(midiData.data(), "MThd", 4) != 0)
+		throw std::runtime_error("parseMidiSequence: not a standard MIDI file");
+
+	const uint16_t division = static_cast<uint16_t>((midiData[12] << 8) | midiData[13]);
+	if (division == 0 || (division & 0x8000))
+		throw std::runtime_error("parseMidiSequence: SMPTE time division is not supported");
+
+	MidiSequence sequence;
+	sequence.timebase = division;
+
+	// First MTrk chunk; its length also cuts off any padding after it
+	std::span<const uint8_t> track;
+	for (size_t pos = 8 + readBE32(midiData.data() + 4); pos + 8 <= midiData.size();)
+	{
+		const uint32_t length = readBE32(midiData.data() + pos + 4);
+		if (std::memcmp(midiData.data() + pos, "MTrk", 4) == 0)
+		{
+			track = midiData.subspan(pos + 8, std::min<size_t>(length, midiData.size() - pos - 8));
+			break;
+		}
+		pos += 8 + size_t(length);
+	}
+
+	uint32_t delta = 0;
+	uint8_t status = 0;
+
+	for (size_t i = 0; i < track.size();)
+	{
+		delta += readVarLen(track, i);
+		if (i >= track.size())
+			break;
+
+		const uint8_t byte = track[i];
+
+		if (byte == 0xFF)
+		{
+			if (i + 1 >= track.size())
+				break;
+			const uint8_t type = track[i + 1];
+			i += 2;
+			const uint32_t length = readVarLen(track, i);
+			if (i + length > track.size() || type == 0x2F)
+				break;
+
+			if (type == 0x51 && length == 3)
+			{
+				const uint32_t tempo = (uint32_t(track[i]) << 16) | (uint32_t(track[i + 1]) << 8) | track[i + 2];
+				sequence.events.push_back({ delta, 0, (uint32_t(MEVT_TEMPO) << 24) | tempo });
+				sequence.length += delta;
+				delta = 0;
+			}
+
+			i += length;
+			continue;
+		}
+
+		if (byte == 0xF0 || byte == 0xF7)
+		{
+			++i;
+			i += readVarLen(track, i);
+			continue;
+		}
+
+		// Running status: data bytes reuse the last status byte
+		if (byte & 0x80)
+		{
+			status = byte;
+			++i;
+		}
+		else if (!status)
+		{
+			++i;
+			continue;
+		}
+
+		const size_t dataBytes = (status & 0xE0) == 0xC0 ? 1 : 2;
+		if (i + dataBytes > track.size())
+			break;
+
+		uint32_t message = status | (uint32_t(track[i]) << 8);
+		if (dataBytes == 2)
+			message |= uint32_t(track[i + 1]) << 16;
+		i += dataBytes;
+
+		sequence.events.push_back({ delta, 0, (uint32_t(MEVT_SHORTMSG) << 24) | message });
+		sequence.length += delta;
+		delta = 0;
+	}
+
+	// Keep the time from the last message to the end of the track, so a looping song keeps its last bar
+	if (!sequence.events.empty())
+	{
+		sequence.events.push_back({ delta, 0, uint32_t(MEVT_NOP) << 24 });
+		sequence.length += delta;
+	}
+
+	return sequence;
+}
+
+MusicPlayer::~MusicPlayer()
+{
+	shutdown();
+}
+
+//
+// Switch to a song from XMI.RL, e.g. "agu16"; converted on first use
+//
+void MusicPlayer::play(const std::string& song, int fadeMs)
+{
+	currentSong = song;
+	request({ true, song, nullptr, fadeMs });
+}
+
+//
+// Switch to an already converted sequence
+//
+void MusicPlayer::play(std::shared_ptr<const MidiSequence> sequence, int fadeMs)
+{
+	currentSong.clear();
+	request({ true, {}, std::move(sequence), fadeMs });
+}
+
+//
+// Fade out and leave the device silent
+//
+void MusicPlayer::stop(int fadeMs)
+{
+	if (!worker.joinable())
+		return;
+
+	currentSong.clear();
+	request({ true, {}, nullptr, fadeMs });
+}
+
+//
+// Master volume, 0-100, applied on top of the songs' own channel volumes
+//
+void MusicPlayer::setVolume(int percent)
+{
+	{
+		std::lock_guard lock(mutex);
+		volume = std::clamp(percent, 0, 100);
+	}
+
+	if (wake)
+		SetEvent(wake);
+}
+
+//
+// Stop the music thread and close the device; safe to call more than once
+//
+void MusicPlayer::shutdown()
+{
+	if (!worker.joinable())
+		return;
+
+	{
+		std::lock_guard lock(mutex);
+		quit = true;
+	}
+	SetEvent(wake);
+	worker.join();
+
+	CloseHandle(wake);
+	wake = nullptr;
+	quit = false;
+	pending = {};
+	currentSong.clear();
+}
+
+//
+// Hand a request to the music thread, starting it on first use. Only the
+// latest request counts; one the thread has not picked up yet is replaced.
+//
+void MusicPlayer::request(Request next)
+{
+	{
+		std::lock_guard lock(mutex);
+		pending = std::move(next);
+	}
+
+	if (!worker.joinable())
+	{
+		wake = CreateEventW(nullptr, FALSE, FALSE, nullptr);
+		if (!wake)
+		{
+			std::cerr << "ERROR: Failed to create the music thread event" << std::endl;
+			return;
+		}
+		worker = std::thread(&MusicPlayer::run, this);
+	}
+
+	SetEvent(wake);
+}
+
+//
+// Converted song, or nullptr if it could not be found or converted (also cached)
+//
+std::shared_ptr<const MidiSequence> MusicPlayer::load(const std::string& song)
+{
+	if (auto it = songs.find(song); it != songs.end())
+		return it->second;
+
+	std::shared_ptr<const MidiSequence> sequence;
+
+	try
+	{
+		if (const RLEntry* entry = xmiArchive().find(song))
+		{
+			auto parsed = std::make_shared<MidiSequence>(parseMidiSequence(xmiConverter(*entry)));
+			if (!parsed->events.empty())
+				sequence = std::move(parsed);
+		}
+		else
+		{
+			std::cerr << "ERROR: XMI file not found: " << song << std::endl;
+		}
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << "ERROR: Failed to convert " << song << ": " << e.what() << std::endl;
+	}
+
+	songs[song] = sequence;
+	return sequence;
+}
+
+/*
+===============================================================================
+Function Name: MusicPlayer::run
+
+Description:
+	- The music thread. Opens a midiStream on the MIDI mapper and keeps two
+	blocks of the current song queued on it, refilling each block as the
+	driver returns it. Requests from the main thread start a fade; once a
+	fade-out reaches silence the stream is restarted on the next song,
+	which then fades in.
+
+Notes:
+	- Channel volume (CC 7) events are rewritten with the fade and master
+	volume applied, and while a fade runs every channel's volume is resent
+	every 10 ms. A block holds at most BLOCK_MICROSECONDS of music, so what
+	is already queued never lags the fade by more than two blocks; volumes
+	keep being resent until those blocks have come back.
+	- Songs whose events all fall on tick 0 are played once, not looped.
+===============================================================================
+*/
+void MusicPlayer::run()
+{
+	using Clock = std::chrono::steady_clock;
+
+	HMIDISTRM stream = nullptr;
+	UINT device = MIDI_MAPPER;
+
+	if (midiStreamOpen(&stream, &device, 1, reinterpret_cast<DWORD_PTR>(wake), 0, CALLBACK_EVENT) != MMSYSERR_NOERROR)
+	{
+		std::cerr << "ERROR: Failed to open the MIDI stream; music is disabled" << std::endl;
+		return;
+	}
+
+	const HMIDIOUT out = reinterpret_cast<HMIDIOUT>(stream);
+
+	std::array<std::vector<MidiEvent>, 2> blocks;
+	std::array<MIDIHDR, 2> headers{};
+	std::array<bool, 2> queued{};
+
+	for (size_t i = 0; i < headers.size(); ++i)
+	{
+		blocks[i].resize(blockEvents);
+		headers[i].lpData = reinterpret_cast<LPSTR>(blocks[i].data());
+		headers[i].dwBufferLength = static_cast<DWORD>(blockEvents * sizeof(MidiEvent));
+		midiOutPrepareHeader(out, &headers[i], sizeof(MIDIHDR));
+	}
+
+	std::shared_ptr<const MidiSequence> song;
+	std::shared_ptr<const MidiSequence> next;
+	bool switching = false;                 // Fading out towards next
+	int switchFadeMs = 0;                   // Fade-in for next
+	size_t position = 0;                    // Next event of song to queue
+	bool ended = false;                     // A song played once has been queued to the end
+	uint32_t tempo = DEFAULT_TEMPO;         // At position
+	std::array<uint8_t, 16> channelVolume;
+	channelVolume.fill(DEFAULT_CHANNEL_VOLUME);
+
+	double gain = 0.0;                      // Fade, 0-1
+	double fadeFrom = 0.0, fadeTo = 0.0;
+	Clock::time_point fadeStart;
+	std::chrono::duration<double> fadeLength{};
+	bool fading = false;
+	int settleBlocks = 0;                   // Blocks filled mid-fade still queued
+	int masterVolume = 100;
+
+	auto scaledVolume = [&](size_t channel) {
+		return static_cast<uint32_t>(channelVolume[channel] * gain * masterVolume / 100.0 + 0.5);
+		};
+
+	auto sendVolumes = [&]() {
+		for (size_t channel = 0; channel < channelVolume.size(); ++channel)
+			midiOutShortMsg(out, static_cast<DWORD>(0xB0 | channel | (7 << 8) | (scaledVolume(channel) << 16)));
+		};
+
+	auto startFade = [&](double target, int milliseconds) {
+		fadeFrom = gain;
+		fadeTo = target;
+		fadeStart = Clock::now();
+		fadeLength = std::chrono::milliseconds(std::max(milliseconds, 0));
+		fading = true;
+		};
+
+	// Queue the next stretch of song into block i
+	auto fill = [&](size_t i) {
+		const bool loops = song->length > 0;
+		size_t count = 0;
+		int64_t microseconds = 0;
+
+		while (count < blockEvents && microseconds < BLOCK_MICROSECONDS && !ended)
+		{
+			MidiEvent event = song->events[position];
+			microseconds += int64_t(event.deltaTime) * tempo / song->timebase;
+
+			if (MEVT_EVENTTYPE(event.event) == MEVT_TEMPO)
+			{
+				tempo = event.event & 0xFFFFFF;
+			}
+			else if (isVolumeChange(event.event))
+			{
+				const size_t channel = event.event & 0x0F;
+				channelVolume[channel] = static_cast<uint8_t>((event.event >> 16) & 0x7F);
+				event.event = (event.event & 0xFF00FFFF) | (scaledVolume(channel) << 16);
+			}
+
+			blocks[i][count++] = event;
+
+			if (++position == song->events.size())
+			{
+				position = 0;
+				ended = !loops;
+			}
+		}
+
+		if (count == 0)
+			return;
+
+		headers[i].dwBytesRecorded = static_cast<DWORD>(count * sizeof(MidiEvent));
+		queued[i] = midiStreamOut(stream, &headers[i], sizeof(MIDIHDR)) == MMSYSERR_NOERROR;
+		};
+
+	// Silence the device and restart the stream on sequence (nullptr: stay silent)
+	auto startSong = [&](std::shared_ptr<const MidiSequence> sequence) {
+		midiStreamStop(stream);
+		midiOutReset(out);
+		queued = {};
+		settleBlocks = 0;	// The blocks filled mid-fade went with the stream
+
+		song = std::move(sequence);
+		position = 0;
+		ended = false;
+		tempo = DEFAULT_TEMPO;
+		channelVolume.fill(DEFAULT_CHANNEL_VOLUME);
+
+		if (!song)
+			return;
+
+		MIDIPROPTIMEDIV timeDiv{ sizeof(MIDIPROPTIMEDIV), song->timebase };
+		midiStreamProperty(stream, reinterpret_cast<LPBYTE>(&timeDiv), MIDIPROP_SET | MIDIPROP_TIMEDIV);
+		MIDIPROPTEMPO tempoProperty{ sizeof(MIDIPROPTEMPO), DEFAULT_TEMPO };
+		midiStreamProperty(stream, reinterpret_cast<LPBYTE>(&tempoProperty), MIDIPROP_SET | MIDIPROP_TEMPO);
+
+		for (size_t i = 0; i < headers.size(); ++i)
+			fill(i);
+		midiStreamRestart(stream);
+		};
+
+	for (;;)
+	{
+		Request latest;
+		int requestedVolume;
+		{
+			std::lock_guard lock(mutex);
+			if (quit)
+				break;
+			latest = std::exchange(pending, {});
+			requestedVolume = volume;
+		}
+
+		if (requestedVolume != masterVolume)
+		{
+			masterVolume = requestedVolume;
+			sendVolumes();
+		}
+
+		if (latest.pending)
+		{
+			next = latest.sequence ? latest.sequence : latest.song.empty() ? nullptr : load(latest.song);
+			switching = true;
+			switchFadeMs = latest.fadeMs;
+			startFade(0.0, song ? latest.fadeMs : 0);
+		}
+
+		if (fading)
+		{
+			const double elapsed = fadeLength.count() > 0 ? (Clock::now() - fadeStart) / fadeLength : 1.0;
+			gain = fadeFrom + (fadeTo - fadeFrom) * std::min(elapsed, 1.0);
+			sendVolumes();
+
+			if (elapsed >= 1.0)
+			{
+				fading = false;
+				// Only blocks still queued come back to count down
+				settleBlocks = static_cast<int>(std::count(queued.begin(), queued.end(), true));
+			}
+		}
+		else if (settleBlocks > 0)
+		{
+			sendVolumes();
+		}
+
+		if (switching && !fading)
+		{
+			switching = false;
+			gain = 0.0;
+			startSong(std::move(next));
+			next = nullptr;
+
+			if (song)
+				startFade(1.0, switchFadeMs);
+		}
+
+		// Refill whatever the driver has handed back
+		for (size_t i = 0; i < headers.size(); ++i)
+		{
+			if (queued[i] && (headers[i].dwFlags & MHDR_DONE))
+			{
+				queued[i] = false;
+				if (settleBlocks > 0)
+					--settleBlocks;
+				if (song)
+					fill(i);
+			}
+		}
+
+		WaitForSingleObject(wake, fading || switching || settleBlocks > 0 ? 10 : INFINITE);
+	}
+
+	midiStreamStop(stream);
+	midiOutReset(out);
+	for (auto& header : headers)
+		midiOutUnprepareHeader(out, &header, sizeof(MIDIHDR));
+	midiStreamClose(stream);
+}
\ No newline at end of file
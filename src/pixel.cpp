@@ -0,0 +1,259 @@
+// pixel.cpp
+
+#include <intrin.h>
+#include <immintrin.h>
+#include <algorithm>
+
+#include "pixel.h"
+
+/* ============================================================================
+							Kernel Selection
+   ============================================================================
+*/
+
+namespace
+{
+	enum class SimdLevel { Scalar, SSSE3, AVX2 };
+
+	//
+	// Highest instruction set usable on this CPU (and enabled by the OS for AVX)
+	//
+	SimdLevel detectSimdLevel()
+	{
+		int info[4]{};
+		__cpuid(info, 0);
+		const int maxLeaf = info[0];
+
+		__cpuid(info, 1);
+		const bool ssse3 = (info[2] & (1 << 9)) != 0;
+		const bool osxsave = (info[2] & (1 << 27)) != 0;
+		const bool avx = (info[2] & (1 << 28)) != 0;
+
+		bool avx2 = false;
+		if (maxLeaf >= 7 && osxsave && avx && (_xgetbv(0) & 0x6) == 0x6)
+		{
+			__cpuidex(info, 7, 0);
+			avx2 = (info[1] & (1 << 5)) != 0;
+		}
+
+		return avx2 ? SimdLevel::AVX2 : ssse3 ? SimdLevel::SSSE3 : SimdLevel::Scalar;
+	}
+
+	const SimdLevel simdLevel = detectSimdLevel();
+
+	constexpr uint32_t opaque = 0xFF000000u;
+
+	//
+	// RGB -> BGRA
+	//
+	void rgbToBGRAScalar(const uint8_t* rgb, uint32_t* bgra, size_t count)
+	{
+		for (size_t i = 0; i < count; ++i, rgb += 3)
+			bgra[i] = opaque | (uint32_t(rgb[0]) << 16) | (uint32_t(rgb[1]) << 8) | rgb[2];
+	}
+
+	// Moves R and B of four packed RGB pixels into BGRA order, alpha slot zeroed
+	inline __m128i rgbShuffleMask()
+	{
+		return _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+	}
+
+	size_t rgbToBGRASSSE3(const uint8_t* rgb, uint32_t* bgra, size_t count)
+	{
+		const __m128i mask = rgbShuffleMask();
+		const __m128i alpha = _mm_set1_epi32(static_cast<int>(opaque));
+
+		// Each load reads 16 bytes for 12 bytes of pixels, so stop short of the end
+		size_t i = 0;
+		for (; i + 6 <= count; i += 4)
+		{
+			const __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgb + i * 3));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(bgra + i), _mm_or_si128(_mm_shuffle_epi8(pixels, mask), alpha));
+		}
+
+		return i;
+	}
+
+	size_t rgbToBGRAAVX2(const uint8_t* rgb, uint32_t* bgra, size_t count)
+	{
+		const __m256i mask = _mm256_broadcastsi128_si256(rgbShuffleMask());
+		const __m256i alpha = _mm256_set1_epi32(static_cast<int>(opaque));
+
+		// Two 4-pixel groups per iteration, one per 128-bit lane
+		size_t i = 0;
+		for (; i + 10 <= count; i += 8)
+		{
+			const uint8_t* source = rgb + i * 3;
+			const __m256i pixels = _mm256_inserti128_si256(
+				_mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(source))),
+				_mm_loadu_si128(reinterpret_cast<const __m128i*>(source + 12)), 1);
+
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(bgra + i), _mm256_or_si256(_mm256_shuffle_epi8(pixels, mask), alpha));
+		}
+
+		return i;
+	}
+
+	//
+	// Palette indices -> BGRA
+	//
+	void indexedToBGRAScalar(const uint8_t* indices, const uint32_t* lut, uint32_t* bgra, size_t count)
+	{
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			bgra[i] = lut[indices[i]];
+			bgra[i + 1] = lut[indices[i + 1]];
+			bgra[i + 2] = lut[indices[i + 2]];
+			bgra[i + 3] = lut[indices[i + 3]];
+		}
+		for (; i < count; ++i)
+			bgra[i] = lut[indices[i]];
+	}
+
+	size_t indexedToBGRAAVX2(const uint8_t* indices, const uint32_t* lut, uint32_t* bgra, size_t count)
+	{
+		const int* table = reinterpret_cast<const int*>(lut);
+
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8)
+		{
+			const __m256i index = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(indices + i)));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(bgra + i), _mm256_i32gather_epi32(table, index, 4));
+		}
+
+		return i;
+	}
+}
+
+/* ============================================================================
+							Public Interface
+   ============================================================================
+*/
+
+//
+// BGRA texel for every palette entry
+//
+BGRALookup buildBGRALookup(std::span<const RGBColor> palette)
+{
+	BGRALookup lut{};
+	const size_t count = std::min(palette.size(), lut.size());
+
+	for (size_t i = 0; i < count; ++i)
+		lut[i] = opaque | (uint32_t(palette[i].r) << 16) | (uint32_t(palette[i].g) << 8) | palette[i].b;
+
+	return lut;
+}
+
+/*
+===============================================================================
+Function Name: convertRGBToBGRA
+
+Description:
+	- Converts packed 8-bit RGB pixels to opaque BGRA texels (B, G, R, A in
+	memory), as expected by DXGI_FORMAT_B8G8R8A8_UNORM and
+	VK_FORMAT_B8G8R8A8_UNORM.
+
+Parameters:
+	- rgb: 3 bytes per pixel
+	- bgra: Receives min(rgb.size() / 3, bgra.size()) texels
+===============================================================================
+*/
+void convertRGBToBGRA(std::span<const uint8_t> rgb, std::span<uint32_t> bgra)
+{
+	const size_t count = std::min(rgb.size() / 3, bgra.size());
+	size_t done = 0;
+
+	switch (simdLevel)
+	{
+	case SimdLevel::AVX2:
+		done = rgbToBGRAAVX2(rgb.data(), bgra.data(), count);
+		break;
+	case SimdLevel::SSSE3:
+		done = rgbToBGRASSSE3(rgb.data(), bgra.data(), count);
+		break;
+	default:
+		break;
+	}
+
+	rgbToBGRAScalar(rgb.data() + done * 3, bgra.data() + done, count - done);
+}
+
+//
+// Looks up BGRA texels for 8-bit palette indices
+//
+void convertIndexedToBGRA(std::span<const uint8_t> indices, const BGRALookup& lut, std::span<uint32_t> bgra)
+{
+	const size_t count = std::min(indices.size(), bgra.size());
+	size_t done = 0;
+
+	if (simdLevel == SimdLevel::AVX2)
+		done = indexedToBGRAAVX2(indices.data(), lut.data(), bgra.data(), count);
+
+	indexedToBGRAScalar(indices.data() + done, lut.data(), bgra.data() + done, count - done);
+}
+
+//
+// Expand an indexed frame to opaque BGRA texels for upload; output holds
+// width * height entries
+//
+void expandToBGRA(const IndexedFrame& frame, std::span<uint32_t> output)
+{
+	const PixelRect all{ 0, 0, frame.width, frame.height };
+	expandToBGRA(frame, output, std::span(&all, 1));
+}
+
+//
+// Same, but only the given rectangles of output (laid out like the frame)
+// are written
+//
+void expandToBGRA(const IndexedFrame& frame, std::span<uint32_t> output, std::span<const PixelRect> rects)
+{
+	if (output.size() < frame.pixels.size()) return;
+
+	const BGRALookup lut = buildBGRALookup(frame.palette);
+	const std::span<const uint8_t> pixels = frame.pixels;
+
+	for (const PixelRect& rect : rects)
+	{
+		// A rectangle spanning whole rows is contiguous, so convert it in one go
+		if (rect.x == 0 && rect.width == frame.width)
+		{
+			const size_t start = static_cast<size_t>(rect.y) * frame.width;
+			const size_t count = static_cast<size_t>(rect.height) * frame.width;
+			convertIndexedToBGRA(pixels.subspan(start, count), lut, output.subspan(start, count));
+			continue;
+		}
+
+		for (int y = rect.y; y < rect.y + rect.height; ++y)
+		{
+			const size_t row = static_cast<size_t>(y) * frame.width + rect.x;
+			convertIndexedToBGRA(pixels.subspan(row, rect.width), lut, output.subspan(row, rect.width));
+		}
+	}
+}
+
+//
+// Reusable BGRA output buffer, grown as needed and never shrunk
+//
+std::span<uint32_t> bgraScratch(size_t pixels)
+{
+	static std::vector<uint32_t> buffer;
+	if (buffer.size() < pixels)
+		buffer.resize(pixels);
+
+	return { buffer.data(), pixels };
+}
+
+//
+// Name of the kernel set in use, for diagnostics
+//
+const char* pixelKernelName()
+{
+	switch (simdLevel)
+	{
+	case SimdLevel::AVX2: return "AVX2";
+	case SimdLevel::SSSE3: return "SSSE3";
+	default: return "scalar";
+	}
+}
\ No newline at end of file
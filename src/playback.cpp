@@ -0,0 +1,169 @@
+// playback.cpp
+
+#include <algorithm>
+#include <ranges>
+#include <thread>
+
+#include "playback.h"
+
+FramePipeline::~FramePipeline()
+{
+	stop();
+}
+
+/*
+===============================================================================
+Function Name: FramePipeline::start
+
+Description:
+	- Cancels any clip in progress and starts decoding vdxFile. Frame 0 is
+	decoded on the calling thread so it can be shown immediately; the worker
+	takes over from frame 1.
+
+Parameters:
+	- vdxFile: Parsed VDXFile object. Must stay alive until stop() or the
+	next start().
+	- deferTiles: Hand 0x20 frames over undecoded (see openVDXStream).
+===============================================================================
+*/
+void FramePipeline::start(const VDXFile& vdxFile, bool deferTiles)
+{
+	WarmClip clip{ .stream = openVDXStream(vdxFile, deferTiles) };
+	if (clip.stream.next())
+		clip.frames.push_back({ clip.stream.frame, clip.stream.dirty });
+
+	start(std::move(clip));
+}
+
+//
+// Start from a clip whose first frames are already decoded
+//
+void FramePipeline::start(WarmClip clip)
+{
+	stop();
+
+	if (clip.frames.empty())
+	{
+		done.store(true, std::memory_order_release);
+		return;
+	}
+
+	for (auto& frame : clip.frames | std::views::take(capacity))
+	{
+		freeSlots.acquire();
+
+		const size_t slot = tail.load(std::memory_order_relaxed);
+		std::swap(ring[slot % capacity], frame);
+		tail.store(slot + 1, std::memory_order_release);
+	}
+
+	worker = std::thread(&FramePipeline::decode, this, std::move(clip.stream));
+}
+
+//
+// Cancel the worker and reset the ring for the next clip
+//
+void FramePipeline::stop()
+{
+	if (worker.joinable())
+	{
+		cancel.store(true, std::memory_order_release);
+		freeSlots.release();	// Wake the worker if the ring is full
+		worker.join();
+	}
+
+	while (freeSlots.try_acquire()) {}
+	freeSlots.release(capacity);
+
+	cancel.store(false, std::memory_order_relaxed);
+	done.store(false, std::memory_order_relaxed);
+	tail.store(0, std::memory_order_relaxed);
+	head = 0;
+}
+
+//
+// Step to the next decoded frame; false if it is not ready (or the clip ended)
+//
+bool FramePipeline::advance()
+{
+	if (head + 1 >= tail.load(std::memory_order_acquire))
+		return false;
+
+	++head;
+	freeSlots.release();	// The previous frame has left the screen
+
+	return true;
+}
+
+//
+// True once the worker is done and the last frame is on screen
+//
+bool FramePipeline::finished() const
+{
+	return done.load(std::memory_order_acquire) && head + 1 >= tail.load(std::memory_order_acquire);
+}
+
+//
+// Frame on screen, nullptr before the first frame
+//
+const DecodedFrame* FramePipeline::current() const
+{
+	if (tail.load(std::memory_order_acquire) == 0)
+		return nullptr;
+
+	return &ring[head % capacity];
+}
+
+//
+// Worker: decode frames until the clip ends or start()/stop() cancels it
+//
+void FramePipeline::decode(VDXStream stream)
+{
+	for (;;)
+	{
+		freeSlots.acquire();
+
+		if (cancel.load(std::memory_order_acquire))
+			return;
+
+		if (!stream.next())
+		{
+			done.store(true, std::memory_order_release);
+			return;
+		}
+
+		publish(stream);
+	}
+}
+
+//
+// Copy the stream's frame into the next free slot and hand it to the consumer
+//
+void FramePipeline::publish(const VDXStream& stream)
+{
+	const size_t slot = tail.load(std::memory_order_relaxed);
+	DecodedFrame& decoded = ring[slot % capacity];
+	decoded.frame.resize(stream.frame.width, stream.frame.height);
+	decoded.frame.palette = stream.frame.palette;
+	decoded.frame.tiles = stream.frame.tiles;
+
+	// Pixels of a deferred keyframe are stale, so they are not worth copying
+	if (stream.frame.tiles.empty())
+		std::ranges::copy(stream.frame.pixels, decoded.frame.pixels.begin());
+
+	decoded.dirty = stream.dirty;
+	tail.store(slot + 1, std::memory_order_release);
+}
+
+//
+// Memory held by a warm clip, for prefetch budgeting
+//
+size_t WarmClip::bytes() const
+{
+	size_t total = sizeof(IndexedFrame) + stream.frame.pixels.capacity() + stream.frame.tiles.capacity() + stream.scratch.capacity();
+
+	for (const auto& decoded : frames)
+		total += sizeof(DecodedFrame) + decoded.frame.pixels.capacity() + decoded.frame.tiles.capacity();
+
+	return total;
+}
\ No newline at end of file
@@ -0,0 +1,362 @@
+// pngwriter.cpp
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+#include "pngwriter.h"
+
+namespace
+{
+	constexpr uint8_t PNG_SIGNATURE[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+	void putBE32(std::vector<uint8_t>& out, uint32_t value)
+	{
+		out.push_back(static_cast<uint8_t>(value >> 24));
+		out.push_back(static_cast<uint8_t>(value >> 16));
+		out.push_back(static_cast<uint8_t>(value >> 8));
+		out.push_back(static_cast<uint8_t>(value));
+	}
+
+	// Length, type, data, CRC over type + data
+	void putChunk(std::vector<uint8_t>& out, const char type[4], const uint8_t* data, uint32_t length)
+	{
+		putBE32(out, length);
+		const size_t typeOffset = out.size();
+		out.insert(out.end(), type, type + 4);
+		out.insert(out.end(), data, data + length);
+		putBE32(out, static_cast<uint32_t>(crc32(0, out.data() + typeOffset, length + 4)));
+	}
+
+	uint8_t paeth(uint8_t a, uint8_t b, uint8_t c)
+	{
+		const int p = a + b - c;
+		const int pa = std::abs(p - a);
+		const int pb = std::abs(p - b);
+		const int pc = std::abs(p - c);
+
+		if (pa <= pb && pa <= pc)
+			return a;
+		return pb <= pc ? b : c;
+	}
+
+	// Filter one row into out[0] (filter type) and out[1..stride]; prev is nullptr on the first row
+	void filterRow(PNGFilter filter, const uint8_t* row, const uint8_t* prev, size_t stride, int bpp, uint8_t* out)
+	{
+		out[0] = static_cast<uint8_t>(filter == PNGFilter::Paeth ? 4 : static_cast<int>(filter));
+		++out;
+
+		for (size_t i = 0; i < stride; ++i)
+		{
+			const uint8_t a = i >= static_cast<size_t>(bpp) ? row[i - bpp] : 0;
+			const uint8_t b = prev ? prev[i] : 0;
+			const uint8_t c = prev && i >= static_cast<size_t>(bpp) ? prev[i - bpp] : 0;
+
+			switch (filter)
+			{
+			case PNGFilter::Sub:   out[i] = static_cast<uint8_t>(row[i] - a); break;
+			case PNGFilter::Up:    out[i] = static_cast<uint8_t>(row[i] - b); break;
+			case PNGFilter::Paeth: out[i] = static_cast<uint8_t>(row[i] - paeth(a, b, c)); break;
+			default:               out[i] = row[i]; break;
+			}
+		}
+	}
+
+	// Heuristic from the PNG spec: bytes as signed, smaller sum compresses better
+	uint64_t filterCost(const uint8_t* filteredRow, size_t stride)
+	{
+		uint64_t sum = 0;
+		for (size_t i = 1; i <= stride; ++i)
+			sum += static_cast<uint64_t>(std::abs(static_cast<int8_t>(filteredRow[i])));
+		return sum;
+	}
+}
+
+PNGEncoder::PNGEncoder(const PNGOptions& options) : options(options)
+{
+	if (deflateInit2(&zstream, options.level, Z_DEFLATED, 15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+	{
+		throw std::runtime_error("Failed to initialize zlib for PNG encoding");
+	}
+}
+
+PNGEncoder::~PNGEncoder()
+{
+	deflateEnd(&zstream);
+}
+
+//
+// Change compression level/filter for subsequent images
+//
+void PNGEncoder::setOptions(const PNGOptions& newOptions)
+{
+	if (newOptions.level != options.level)
+	{
+		deflateReset(&zstream);
+		if (deflateParams(&zstream, newOptions.level, Z_DEFAULT_STRATEGY) != Z_OK)
+		{
+			throw std::runtime_error("Failed to change the PNG compression level");
+		}
+	}
+
+	options = newOptions;
+}
+
+/*
+===============================================================================
+Function Name: PNGEncoder::encode
+
+Description:
+	- Encodes a palette-indexed frame. With options.indexed the PNG keeps
+	the frame's palette (PLTE) and one byte per pixel, about a third of the
+	size of RGB output; otherwise the frame is expanded to RGB first.
+
+Parameters:
+	- frame: Frame to encode. Its pixels must not be stale (frame.tiles empty).
+	- out: Receives the complete PNG file. Its capacity is reused.
+===============================================================================
+*/
+void PNGEncoder::encode(const IndexedFrame& frame, std::vector<uint8_t>& out)
+{
+	if (options.indexed)
+	{
+		encodeImage(frame.pixels.data(), frame.width, frame.height, 1, &frame.palette, out);
+		return;
+	}
+
+	const std::vector<uint8_t> rgb = expandToRGB(frame);
+	encodeRGB(rgb.data(), frame.width, frame.height, out);
+}
+
+//
+// Encode width * height packed 8-bit RGB pixels
+//
+void PNGEncoder::encodeRGB(const uint8_t* rgb, int width, int height, std::vector<uint8_t>& out)
+{
+	encodeImage(rgb, width, height, 3, nullptr, out);
+}
+
+//
+// Signature, IHDR, optional PLTE, a single IDAT deflated in place, IEND
+//
+void PNGEncoder::encodeImage(const uint8_t* pixels, int width, int height, int bytesPerPixel,
+	const std::array<RGBColor, 256>* palette, std::vector<uint8_t>& out)
+{
+	// Palette images compress best unfiltered
+	filterRows(pixels, width, height, bytesPerPixel, palette ? PNGFilter::None : options.filter);
+
+	out.clear();
+	out.insert(out.end(), std::begin(PNG_SIGNATURE), std::end(PNG_SIGNATURE));
+
+	std::vector<uint8_t> header;
+	header.reserve(13);
+	putBE32(header, static_cast<uint32_t>(width));
+	putBE32(header, static_cast<uint32_t>(height));
+	header.push_back(8);                    // Bit depth
+	header.push_back(palette ? 3 : 2);      // Colour type: indexed or RGB
+	header.push_back(0);                    // Deflate
+	header.push_back(0);                    // Adaptive filtering
+	header.push_back(0);                    // No interlace
+	putChunk(out, "IHDR", header.data(), static_cast<uint32_t>(header.size()));
+
+	if (palette)
+	{
+		uint8_t plte[256 * 3];
+		for (size_t i = 0; i < palette->size(); ++i)
+		{
+			plte[i * 3] = (*palette)[i].r;
+			plte[i * 3 + 1] = (*palette)[i].g;
+			plte[i * 3 + 2] = (*palette)[i].b;
+		}
+		putChunk(out, "PLTE", plte, sizeof(plte));
+	}
+
+	deflateReset(&zstream);
+
+	const size_t idatOffset = out.size();
+	const uLong bound = deflateBound(&zstream, static_cast<uLong>(filtered.size()));
+	out.resize(idatOffset + 8 + bound);
+
+	zstream.next_in = filtered.data();
+	zstream.avail_in = static_cast<uInt>(filtered.size());
+	zstream.next_out = out.data() + idatOffset + 8;
+	zstream.avail_out = static_cast<uInt>(bound);
+
+	if (deflate(&zstream, Z_FINISH) != Z_STREAM_END)
+	{
+		throw std::runtime_error("PNG compression failed");
+	}
+
+	const uint32_t length = static_cast<uint32_t>(zstream.total_out);
+	out.resize(idatOffset + 8 + length);
+
+	uint8_t* idat = out.data() + idatOffset;
+	idat[0] = static_cast<uint8_t>(length >> 24);
+	idat[1] = static_cast<uint8_t>(length >> 16);
+	idat[2] = static_cast<uint8_t>(length >> 8);
+	idat[3] = static_cast<uint8_t>(length);
+	std::copy_n("IDAT", 4, idat + 4);
+	putBE32(out, static_cast<uint32_t>(crc32(0, out.data() + idatOffset + 4, length + 4)));
+
+	putChunk(out, "IEND", nullptr, 0);
+}
+
+//
+// Fill filtered with every row, each prefixed by its filter type byte
+//
+void PNGEncoder::filterRows(const uint8_t* pixels, int width, int height, int bytesPerPixel, PNGFilter filter)
+{
+	const size_t stride = static_cast<size_t>(width) * bytesPerPixel;
+	filtered.resize((stride + 1) * height);
+
+	if (filter == PNGFilter::Adaptive)
+		candidates.resize((stride + 1) * 4);
+
+	for (int y = 0; y < height; ++y)
+	{
+		const uint8_t* row = pixels + y * stride;
+		const uint8_t* prev = y > 0 ? row - stride : nullptr;
+		uint8_t* out = filtered.data() + y * (stride + 1);
+
+		if (filter != PNGFilter::Adaptive)
+		{
+			filterRow(filter, row, prev, stride, bytesPerPixel, out);
+			continue;
+		}
+
+		// Start from None and keep whichever trial row is cheapest
+		filterRow(PNGFilter::None, row, prev, stride, bytesPerPixel, out);
+		uint64_t bestCost = filterCost(out, stride);
+		const uint8_t* best = out;
+
+		constexpr PNGFilter trials[] = { PNGFilter::Sub, PNGFilter::Up, PNGFilter::Paeth };
+		for (size_t t = 0; t < std::size(trials); ++t)
+		{
+			uint8_t* candidate = candidates.data() + t * (stride + 1);
+			filterRow(trials[t], row, prev, stride, bytesPerPixel, candidate);
+
+			if (const uint64_t cost = filterCost(candidate, stride); cost < bestCost)
+			{
+				bestCost = cost;
+				best = candidate;
+			}
+		}
+
+		if (best != out)
+			std::copy_n(best, stride + 1, out);
+	}
+}
+
+AsyncFileWriter::AsyncFileWriter(size_t maxQueuedBytes) : maxQueuedBytes(maxQueuedBytes)
+{
+	worker = std::thread(&AsyncFileWriter::run, this);
+}
+
+AsyncFileWriter::~AsyncFileWriter()
+{
+	{
+		std::lock_guard lock(mutex);
+		quit = true;
+	}
+	wake.notify_all();
+	worker.join();
+}
+
+//
+// An empty buffer, reusing the capacity of one that has already been written
+//
+std::vector<uint8_t> AsyncFileWriter::acquire()
+{
+	std::lock_guard lock(mutex);
+
+	if (spare.empty())
+		return {};
+
+	std::vector<uint8_t> buffer = std::move(spare.back());
+	spare.pop_back();
+	buffer.clear();
+
+	return buffer;
+}
+
+/*
+===============================================================================
+Function Name: AsyncFileWriter::write
+
+Description:
+	- Queues a buffer to be written to a file by the writer thread.
+
+Parameters:
+	- path: File to create or overwrite.
+	- data: Complete file contents.
+
+Notes:
+	- Blocks while more than maxQueuedBytes are waiting to be written, so
+	a producer that outruns the disk cannot use unbounded memory.
+	- Failures are reported on stderr and counted in failures().
+===============================================================================
+*/
+void AsyncFileWriter::write(std::filesystem::path path, std::vector<uint8_t> data)
+{
+	std::unique_lock lock(mutex);
+	space.wait(lock, [&] { return queuedBytes == 0 || queuedBytes + data.size() <= maxQueuedBytes; });
+
+	queuedBytes += data.size();
+	queue.push_back({ std::move(path), std::move(data) });
+
+	lock.unlock();
+	wake.notify_one();
+}
+
+//
+// Block until everything queued so far is on disk
+//
+void AsyncFileWriter::flush()
+{
+	std::unique_lock lock(mutex);
+	space.wait(lock, [this] { return queue.empty() && !busy; });
+}
+
+//
+// Writer thread: one file at a time, in submission order
+//
+void AsyncFileWriter::run()
+{
+	std::unique_lock lock(mutex);
+
+	for (;;)
+	{
+		wake.wait(lock, [this] { return quit || !queue.empty(); });
+
+		if (queue.empty())
+			return;
+
+		Job job = std::move(queue.front());
+		queue.pop_front();
+		busy = true;
+		lock.unlock();
+
+		std::ofstream file(job.path, std::ios::binary);
+		file.write(reinterpret_cast<const char*>(job.data.data()), job.data.size());
+
+		if (file)
+		{
+			written.fetch_add(job.data.size(), std::memory_order_relaxed);
+			files.fetch_add(1, std::memory_order_relaxed);
+		}
+		else
+		{
+			failed.fetch_add(1, std::memory_order_relaxed);
+			std::cerr << "ERROR: Failed to write: " << job.path.string() << std::endl;
+		}
+
+		lock.lock();
+		busy = false;
+		queuedBytes -= job.data.size();
+		if (spare.size() < 8)
+			spare.push_back(std::move(job.data));
+		space.notify_all();
+	}
+}
\ No newline at end of file
@@ -0,0 +1,92 @@
+// prefetch.cpp
+
+#include "prefetch.h"
+
+Prefetcher::~Prefetcher()
+{
+	if (worker.joinable())
+	{
+		{
+			std::lock_guard lock(mutex);
+			quit = true;
+			++generation;
+		}
+		wake.notify_all();
+		worker.join();
+	}
+}
+
+/*
+===============================================================================
+Function Name: Prefetcher::request
+
+Description:
+	- Replaces the pending work with the given navigation targets. Targets
+	that are already cached only move to the front of the LRU list.
+
+Parameters:
+	- targets: Views reachable from the current one.
+
+Notes:
+	- The worker thread is started on the first request.
+===============================================================================
+*/
+void Prefetcher::request(std::vector<Target> targets)
+{
+	{
+		std::lock_guard lock(mutex);
+		queue.clear();
+		++generation;
+
+		for (auto& target : targets)
+		{
+			if (target.vdxFile && !cache.touch(target.key))
+				queue.push_back(std::move(target));
+		}
+
+		if (!worker.joinable())
+			worker = std::thread(&Prefetcher::run, this);
+	}
+	wake.notify_all();
+}
+
+//
+// Worker: warm one target at a time until told to quit
+//
+void Prefetcher::run()
+{
+	std::unique_lock lock(mutex);
+
+	for (;;)
+	{
+		wake.wait(lock, [this] { return quit || !queue.empty(); });
+		if (quit)
+			return;
+
+		Target target = std::move(queue.front());
+		queue.pop_front();
+
+		const uint64_t startGeneration = generation;
+		lock.unlock();
+
+		WarmClip clip{ .stream = openVDXStream(*target.vdxFile, target.deferTiles) };
+
+		bool cancelled = false;
+		while (clip.frames.size() < FramePipeline::capacity && clip.stream.next())
+		{
+			clip.frames.push_back({ clip.stream.frame, clip.stream.dirty });
+
+			std::lock_guard check(mutex);
+			if (quit || generation != startGeneration)
+			{
+				cancelled = true;
+				break;
+			}
+		}
+
+		if (!cancelled && !clip.frames.empty())
+			cache.insert(std::move(target.key), std::move(clip));
+
+		lock.lock();
+	}
+}
\ No newline at end of file
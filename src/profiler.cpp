@@ -0,0 +1,363 @@
+// profiler.cpp
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "profiler.h"
+#include "game.h"
+
+Profiler profiler;
+
+namespace
+{
+	// Trace names, in ProfileScope order
+	const char* const SCOPE_NAMES[] = { "loadView", "processEvents", "lzss", "bitmap", "delta", "convert", "upload", "present" };
+	static_assert(std::size(SCOPE_NAMES) == size_t(ProfileScope::Count));
+
+	// Small id per thread for the trace, in order of first use
+	uint32_t threadIndex()
+	{
+		static std::atomic<uint32_t> next{ 1 };
+		thread_local const uint32_t index = next++;
+		return index;
+	}
+
+	// 3x5 pixel font for the overlay, one row per byte, bit 2 on the left
+	struct Glyph
+	{
+		char c;
+		uint8_t rows[5];
+	};
+
+	constexpr Glyph FONT[] = {
+		{ '0', { 7, 5, 5, 5, 7 } }, { '1', { 2, 6, 2, 2, 7 } }, { '2', { 7, 1, 7, 4, 7 } }, { '3', { 7, 1, 7, 1, 7 } },
+		{ '4', { 5, 5, 7, 1, 1 } }, { '5', { 7, 4, 7, 1, 7 } }, { '6', { 7, 4, 7, 5, 7 } }, { '7', { 7, 1, 1, 1, 1 } },
+		{ '8', { 7, 5, 7, 5, 7 } }, { '9', { 7, 5, 7, 1, 7 } },
+		{ 'A', { 2, 5, 7, 5, 5 } }, { 'B', { 6, 5, 6, 5, 6 } }, { 'C', { 3, 4, 4, 4, 3 } }, { 'D', { 6, 5, 5, 5, 6 } },
+		{ 'E', { 7, 4, 6, 4, 7 } }, { 'F', { 7, 4, 6, 4, 4 } }, { 'G', { 3, 4, 5, 5, 3 } }, { 'H', { 5, 5, 7, 5, 5 } },
+		{ 'I', { 7, 2, 2, 2, 7 } }, { 'J', { 1, 1, 1, 5, 2 } }, { 'K', { 5, 5, 6, 5, 5 } }, { 'L', { 4, 4, 4, 4, 7 } },
+		{ 'M', { 5, 7, 7, 5, 5 } }, { 'N', { 6, 5, 5, 5, 5 } }, { 'O', { 2, 5, 5, 5, 2 } }, { 'P', { 6, 5, 6, 4, 4 } },
+		{ 'Q', { 2, 5, 5, 6, 3 } }, { 'R', { 6, 5, 6, 5, 5 } }, { 'S', { 3, 4, 2, 1, 6 } }, { 'T', { 7, 2, 2, 2, 2 } },
+		{ 'U', { 5, 5, 5, 5, 7 } }, { 'V', { 5, 5, 5, 5, 2 } }, { 'W', { 5, 5, 7, 7, 5 } }, { 'X', { 5, 5, 2, 5, 5 } },
+		{ 'Y', { 5, 5, 2, 2, 2 } }, { 'Z', { 7, 1, 2, 4, 7 } },
+		{ '.', { 0, 0, 0, 0, 2 } }, { '/', { 1, 1, 2, 4, 4 } }, { ':', { 0, 2, 0, 2, 0 } }, { '-', { 0, 0, 7, 0, 0 } },
+		{ '%', { 5, 1, 2, 4, 5 } }
+	};
+
+	constexpr int FONT_SCALE = 2;                   // Window pixels per font pixel
+	constexpr int ADVANCE = 4 * FONT_SCALE;
+	constexpr int LINE_HEIGHT = 7 * FONT_SCALE;
+
+	constexpr int MARGIN = 8;
+	constexpr int PADDING = 6;
+	constexpr int BAR_WIDTH = 2;
+	constexpr int GRAPH_HEIGHT = 80;
+	constexpr size_t AVERAGE_FRAMES = 60;           // Frames averaged for the text
+
+	constexpr uint32_t PANEL_COLOR = 0x101010;
+	constexpr uint32_t TEXT_COLOR = 0xE0E0E0;
+	constexpr uint32_t TARGET_COLOR = 0x808080;
+	constexpr uint32_t ON_TIME_COLOR = 0x40C040;
+	constexpr uint32_t SLOW_COLOR = 0xE0C040;
+	constexpr uint32_t LATE_COLOR = 0xE04040;
+	constexpr uint32_t DECODE_COLOR = 0x40A0E0;
+
+	// One rect per horizontal run of lit font pixels
+	void drawText(std::vector<OverlayRect>& rects, int x, int y, const std::string& text)
+	{
+		for (char c : text)
+		{
+			const Glyph* glyph = std::find_if(std::begin(FONT), std::end(FONT), [c](const Glyph& g) { return g.c == c; });
+
+			if (glyph != std::end(FONT))
+			{
+				for (int row = 0; row < 5; ++row)
+				{
+					for (int column = 0; column < 3;)
+					{
+						if (!(glyph->rows[row] & (4 >> column)))
+						{
+							++column;
+							continue;
+						}
+
+						const int first = column;
+						while (column < 3 && (glyph->rows[row] & (4 >> column)))
+							++column;
+
+						rects.push_back({ x + first * FONT_SCALE, y + row * FONT_SCALE,
+							(column - first) * FONT_SCALE, FONT_SCALE, TEXT_COLOR });
+					}
+				}
+			}
+
+			x += ADVANCE;
+		}
+	}
+
+	template <typename... Args>
+	std::string format(const char* pattern, Args... args)
+	{
+		char buffer[128];
+		std::snprintf(buffer, sizeof(buffer), pattern, args...);
+		return buffer;
+	}
+}
+
+//
+// Time spent decoding frames: LZSS plus both chunk decoders
+//
+double ProfileFrame::decodeMs() const
+{
+	return scopeMs[size_t(ProfileScope::LZSS)] + scopeMs[size_t(ProfileScope::Bitmap)] + scopeMs[size_t(ProfileScope::Delta)];
+}
+
+//
+// Start or stop collecting; the span ring is only allocated once enabled
+//
+void Profiler::enable(bool on)
+{
+	std::lock_guard lock(mutex);
+
+	if (on && spans.empty())
+		spans.resize(eventCapacity);
+
+	lastPresent = Clock::now();
+	active.store(on, std::memory_order_relaxed);
+}
+
+//
+// Add a timed span, from any thread
+//
+void Profiler::record(ProfileScope scope, Clock::time_point start, Clock::time_point end)
+{
+	if (!enabled())
+		return;
+
+	const auto micros = [this](Clock::time_point time) {
+		return std::chrono::duration_cast<std::chrono::microseconds>(time - epoch).count();
+		};
+
+	const Span span{ scope, threadIndex(), micros(start), micros(end) - micros(start) };
+	const double ms = std::chrono::duration<double, std::milli>(end - start).count();
+
+	std::lock_guard lock(mutex);
+	spans[spanCount++ % spans.size()] = span;
+	pending.scopeMs[size_t(scope)] += ms;
+}
+
+//
+// Close the current frame; the renderers call this once they have presented
+//
+void Profiler::endFrame()
+{
+	if (!enabled())
+		return;
+
+	const auto now = Clock::now();
+
+	std::lock_guard lock(mutex);
+	pending.frameMs = std::chrono::duration<double, std::milli>(now - lastPresent).count();
+	history[frameCount++ % frameHistory] = pending;
+	pending = {};
+	lastPresent = now;
+}
+
+//
+// Start the next frame now, so time spent idle on a still view is not
+// counted as one long frame
+//
+void Profiler::restartFrame()
+{
+	std::lock_guard lock(mutex);
+	pending = {};
+	lastPresent = Clock::now();
+}
+
+//
+// Frames kept for the overlay, oldest first
+//
+std::vector<ProfileFrame> Profiler::frames() const
+{
+	std::lock_guard lock(mutex);
+
+	const size_t count = std::min(frameCount, frameHistory);
+	std::vector<ProfileFrame> result;
+	result.reserve(count);
+
+	for (size_t i = frameCount - count; i < frameCount; ++i)
+		result.push_back(history[i % frameHistory]);
+
+	return result;
+}
+
+/*
+===============================================================================
+Function Name: Profiler::writeTrace
+
+Description:
+	- Writes the spans still in the ring as a Chrome trace ("X" complete
+	events, timestamps in microseconds).
+
+Parameters:
+	- filename: Where to write the JSON
+
+Return:
+	- bool: true if the file was written
+===============================================================================
+*/
+bool Profiler::writeTrace(const std::string& filename) const
+{
+	std::vector<Span> ordered;
+	{
+		std::lock_guard lock(mutex);
+
+		const size_t count = std::min(spanCount, spans.size());
+		ordered.reserve(count);
+
+		for (size_t i = spanCount - count; i < spanCount; ++i)
+			ordered.push_back(spans[i % spans.size()]);
+	}
+
+	nlohmann::json events = nlohmann::json::array();
+
+	for (const Span& span : ordered)
+	{
+		events.push_back({
+			{ "name", SCOPE_NAMES[size_t(span.scope)] },
+			{ "cat", "v64tng" },
+			{ "ph", "X" },
+			{ "ts", span.start },
+			{ "dur", span.duration },
+			{ "pid", 1 },
+			{ "tid", span.thread }
+			});
+	}
+
+	std::ofstream file(filename);
+	file << nlohmann::json{ { "traceEvents", events }, { "displayTimeUnit", "ms" } };
+
+	return static_cast<bool>(file);
+}
+
+ScopedTimer::ScopedTimer(ProfileScope scope)
+	: scope(scope), start(profiler.enabled() ? Profiler::Clock::now() : Profiler::Clock::time_point{})
+{
+}
+
+//
+// Record the span so far and stop timing; the destructor then does nothing
+//
+void ScopedTimer::stop()
+{
+	if (start == Profiler::Clock::time_point{})
+		return;
+
+	profiler.record(scope, start, Profiler::Clock::now());
+	start = {};
+}
+
+/*
+===============================================================================
+Function Name: buildProfilerOverlay
+
+Description:
+	- Lays out the overlay panel in the top-left corner of the window: the
+	averages of the last frames as text, and a graph of frame times, one
+	bar per frame with its decode time along the bottom.
+
+Return:
+	- std::vector<OverlayRect>: Rectangles to fill in order, later ones on
+	top. Empty while the overlay is hidden.
+
+Notes:
+	- Bars are green on time, yellow up to 1.5x the frame interval and red
+	beyond; the grey line is the frame interval at state.currentFPS.
+===============================================================================
+*/
+std::vector<OverlayRect> buildProfilerOverlay()
+{
+	std::vector<OverlayRect> rects;
+	if (!profiler.overlay || !profiler.enabled())
+		return rects;
+
+	const std::vector<ProfileFrame> frames = profiler.frames();
+
+	// Averages (and the worst loadView) over the most recent frames
+	ProfileFrame average;
+	double loadViewMs = 0.0;
+	const size_t averaged = std::min(frames.size(), AVERAGE_FRAMES);
+
+	for (size_t i = frames.size() - averaged; i < frames.size(); ++i)
+	{
+		average.frameMs += frames[i].frameMs / averaged;
+		for (size_t scope = 0; scope < average.scopeMs.size(); ++scope)
+			average.scopeMs[scope] += frames[i].scopeMs[scope] / averaged;
+		loadViewMs = std::max(loadViewMs, frames[i].scopeMs[size_t(ProfileScope::LoadView)]);
+	}
+
+	const auto scopeMs = [&average](ProfileScope scope) { return average.scopeMs[size_t(scope)]; };
+	const ClipCache::Stats cache = state.clipCache.stats();
+
+	const std::vector<std::string> lines = {
+		format("FRAME %.1f MS  %.1f FPS", average.frameMs, average.frameMs > 0.0 ? 1000.0 / average.frameMs : 0.0),
+		format("DECODE %.1f MS  LZSS %.1f  BITMAP %.1f  DELTA %.1f", average.decodeMs(),
+			scopeMs(ProfileScope::LZSS), scopeMs(ProfileScope::Bitmap), scopeMs(ProfileScope::Delta)),
+		format("CONVERT %.1f  UPLOAD %.1f  PRESENT %.1f MS",
+			scopeMs(ProfileScope::Convert), scopeMs(ProfileScope::Upload), scopeMs(ProfileScope::Present)),
+		format("EVENTS %.1f MS  LOAD VIEW %.1f MS", scopeMs(ProfileScope::Events), loadViewMs),
+		format("CACHE %llu HITS  %llu MISSES  %zu CLIPS",
+			static_cast<unsigned long long>(cache.hits), static_cast<unsigned long long>(cache.misses), cache.clips),
+		format("RESIDENT %zu / %zu MB", cache.bytes / (1024 * 1024), cache.budget / (1024 * 1024)),
+		format("LATE %zu  DROPPED %zu", state.animation.lateFrames, state.animation.droppedFrames)
+	};
+
+	size_t longest = 0;
+	for (const std::string& line : lines)
+		longest = std::max(longest, line.size());
+
+	const int graphWidth = static_cast<int>(Profiler::frameHistory) * BAR_WIDTH;
+	const int textHeight = static_cast<int>(lines.size()) * LINE_HEIGHT;
+	const int panelWidth = PADDING * 2 + std::max(graphWidth, static_cast<int>(longest) * ADVANCE);
+	const int panelHeight = PADDING * 3 + textHeight + GRAPH_HEIGHT;
+
+	rects.push_back({ MARGIN, MARGIN, panelWidth, panelHeight, PANEL_COLOR });
+
+	for (size_t i = 0; i < lines.size(); ++i)
+		drawText(rects, MARGIN + PADDING, MARGIN + PADDING + static_cast<int>(i) * LINE_HEIGHT, lines[i]);
+
+	// Graph spans two frame intervals, newest frame on the right
+	const double targetMs = 1000.0 / state.currentFPS;
+	const int graphX = MARGIN + PADDING;
+	const int graphBottom = MARGIN + PADDING * 2 + textHeight + GRAPH_HEIGHT;
+	const auto barHeight = [targetMs](double ms) {
+		return std::clamp(static_cast<int>(ms / (targetMs * 2.0) * GRAPH_HEIGHT + 0.5), 1, GRAPH_HEIGHT);
+		};
+
+	for (size_t i = 0; i < frames.size(); ++i)
+	{
+		const ProfileFrame& frame = frames[i];
+		const int x = graphX + static_cast<int>(Profiler::frameHistory - frames.size() + i) * BAR_WIDTH;
+		const int height = barHeight(frame.frameMs);
+		const uint32_t color = frame.frameMs <= targetMs * 1.05 ? ON_TIME_COLOR
+			: frame.frameMs <= targetMs * 1.5 ? SLOW_COLOR : LATE_COLOR;
+
+		rects.push_back({ x, graphBottom - height, BAR_WIDTH, height, color });
+
+		if (frame.decodeMs() > 0.0)
+		{
+			const int decodeHeight = std::min(barHeight(frame.decodeMs()), height);
+			rects.push_back({ x, graphBottom - decodeHeight, BAR_WIDTH, decodeHeight, DECODE_COLOR });
+		}
+	}
+
+	rects.push_back({ graphX, graphBottom - barHeight(targetMs), graphWidth, 1, TARGET_COLOR });
+
+	return rects;
+}
\ No newline at end of file
@@ -14,7 +14,7 @@ std::vector<RLEntry> parseRLFile(const std::string& rlFilename)
 {
     std::vector<RLEntry> rlEntries;
 
-    std::ifstream rlFile(rlFilename, std::ios::binary);
+    std::ifstream rlFile(rlFilename, std::ios::binary | std::ios::ate);
 
     if (!rlFile)
     {
@@ -22,20 +22,24 @@ std::vector<RLEntry> parseRLFile(const std::string& rlFilename)
         return rlEntries;
     }
 
-    // Read the VDX file entries
-    while (!rlFile.eof())
-    {
-        RLEntry entry;
-        char block[20] = { 0 };
+    // Read the whole table at once; it is only a few KB
+    std::vector<char> table(static_cast<size_t>(rlFile.tellg()));
+    rlFile.seekg(0, std::ios::beg);
+    rlFile.read(table.data(), table.size());
+    table.resize(static_cast<size_t>(rlFile.gcount()));
 
-        rlFile.read(block, sizeof(block));
+    constexpr size_t RECORD_SIZE = 20;
+    rlEntries.reserve(table.size() / RECORD_SIZE);
 
-        if (rlFile.gcount() < sizeof(block))
-            break;
+    // Read the VDX file entries
+    for (size_t offset = 0; offset + RECORD_SIZE <= table.size(); offset += RECORD_SIZE)
+    {
+        const char* block = table.data() + offset;
 
+        RLEntry entry;
         entry.filename.assign(block, block + 12);
-        entry.offset = *reinterpret_cast<uint32_t*>(block + 12);
-        entry.length = *reinterpret_cast<uint32_t*>(block + 16);
+        entry.offset = *reinterpret_cast<const uint32_t*>(block + 12);
+        entry.length = *reinterpret_cast<const uint32_t*>(block + 16);
 
         rlEntries.push_back(entry);
     }
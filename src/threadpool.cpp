@@ -0,0 +1,155 @@
+// threadpool.cpp
+
+#include <algorithm>
+
+#include "threadpool.h"
+
+namespace
+{
+	// Identifies the pool and deque of the worker running the current task
+	thread_local const ThreadPool* currentPool = nullptr;
+	thread_local size_t currentQueue = 0;
+}
+
+ThreadPool::ThreadPool(unsigned threadCount)
+{
+	threadCount = std::max(threadCount, 1u);
+
+	queues.reserve(threadCount);
+	for (unsigned i = 0; i < threadCount; ++i)
+		queues.push_back(std::make_unique<Queue>());
+
+	workers.reserve(threadCount);
+	for (unsigned i = 0; i < threadCount; ++i)
+		workers.emplace_back(&ThreadPool::run, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+	wait();
+
+	{
+		std::lock_guard lock(sleepMutex);
+		quit = true;
+	}
+	wake.notify_all();
+
+	for (auto& worker : workers)
+		worker.join();
+}
+
+/*
+===============================================================================
+Function Name: ThreadPool::submit
+
+Description:
+	- Queues a task. From a worker of this pool the task goes on that
+	worker's own deque; from any other thread the deques are filled
+	round-robin.
+
+Parameters:
+	- task: Work to run on one of the pool's threads.
+===============================================================================
+*/
+void ThreadPool::submit(Task task)
+{
+	const size_t target = currentPool == this
+		? currentQueue
+		: nextQueue.fetch_add(1, std::memory_order_relaxed) % queues.size();
+
+	// Counted before it becomes visible, so wait() cannot see zero early
+	pending.fetch_add(1, std::memory_order_relaxed);
+
+	{
+		std::lock_guard lock(queues[target]->mutex);
+		queues[target]->tasks.push_back(std::move(task));
+	}
+
+	{
+		std::lock_guard lock(sleepMutex);
+		queued.fetch_add(1, std::memory_order_release);
+	}
+	wake.notify_one();
+}
+
+//
+// Block until every submitted task, and everything those tasks submitted, has run
+//
+void ThreadPool::wait()
+{
+	std::unique_lock lock(sleepMutex);
+	idle.wait(lock, [this] { return pending.load(std::memory_order_acquire) == 0; });
+}
+
+//
+// Newest task from the worker's own deque
+//
+bool ThreadPool::pop(size_t self, Task& task)
+{
+	Queue& queue = *queues[self];
+	std::lock_guard lock(queue.mutex);
+
+	if (queue.tasks.empty())
+		return false;
+
+	task = std::move(queue.tasks.back());
+	queue.tasks.pop_back();
+
+	return true;
+}
+
+//
+// Oldest task from any other worker's deque, starting with the next one along
+//
+bool ThreadPool::steal(size_t self, Task& task)
+{
+	for (size_t i = 1; i < queues.size(); ++i)
+	{
+		Queue& queue = *queues[(self + i) % queues.size()];
+		std::lock_guard lock(queue.mutex);
+
+		if (queue.tasks.empty())
+			continue;
+
+		task = std::move(queue.tasks.front());
+		queue.tasks.pop_front();
+
+		return true;
+	}
+
+	return false;
+}
+
+//
+// Worker: drain the own deque, then steal, then sleep until more work arrives
+//
+void ThreadPool::run(size_t self)
+{
+	currentPool = this;
+	currentQueue = self;
+
+	for (;;)
+	{
+		Task task;
+
+		if (pop(self, task) || steal(self, task))
+		{
+			queued.fetch_sub(1, std::memory_order_relaxed);
+			task();
+			task = nullptr;
+
+			if (pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			{
+				std::lock_guard lock(sleepMutex);
+				idle.notify_all();
+			}
+			continue;
+		}
+
+		std::unique_lock lock(sleepMutex);
+		wake.wait(lock, [this] { return quit || queued.load(std::memory_order_acquire) > 0; });
+
+		if (quit && queued.load(std::memory_order_acquire) == 0)
+			return;
+	}
+}
\ No newline at end of file
@@ -5,12 +5,16 @@
 #include <fstream>
 #include <filesystem>
 #include <iostream>
+#include <span>
+#include <memory>
+#include <algorithm>
 
 #include "vdx.h"
 #include "lzss.h"
 #include "bitmap.h"
 #include "delta.h"
 #include "config.h"
+#include "profiler.h"
 
 /*
 ===============================================================================
@@ -21,27 +25,30 @@ Description:
 
 Parameters:
 	- filename: The filename for the VDX data.
-	- buffer: A vector containing the VDX data to be parsed.
+	- buffer: The VDX data to be parsed.
+	- storage: Owner of the memory behind buffer, e.g. a mapped GJD archive.
 
 Return:
 	- A VDXFile object containing the parsed VDX data.
 
 Notes:
-	- None.
+	- Chunk payloads are not copied; each chunk.raw is a view into buffer and
+	storage is kept alive by the returned VDXFile.
 ===============================================================================
 */
-VDXFile parseVDXFile(const std::string& filename, const std::vector<uint8_t>& buffer)
+VDXFile parseVDXFile(const std::string& filename, std::span<const uint8_t> buffer, std::shared_ptr<const void> storage)
 {
 	VDXFile vdxFile;
 	vdxFile.filename = std::filesystem::path(filename).filename().string();
 	vdxFile.filename = vdxFile.filename.substr(0, vdxFile.filename.find_last_of('.'));
+	vdxFile.storage = std::move(storage);
 
 	vdxFile.identifier = buffer[0] | (buffer[1] << 8);
 	std::copy(buffer.begin() + 2, buffer.begin() + 8, vdxFile.unknown.begin());
 
 	size_t offset = 8;
 
-	while (offset < buffer.size())
+	while (offset + 8 <= buffer.size())
 	{
 		VDXChunk chunk;
 		chunk.chunkType = buffer[offset];
@@ -50,15 +57,75 @@ VDXFile parseVDXFile(const std::string& filename, const std::vector<uint8_t>& bu
 		chunk.lengthMask = buffer[offset + 6];
 		chunk.lengthBits = buffer[offset + 7];
 		offset += 8;
-		chunk.data.assign(buffer.begin() + offset, buffer.begin() + offset + chunk.dataSize);
+		chunk.raw = buffer.subspan(offset, std::min<size_t>(chunk.dataSize, buffer.size() - offset));
 		offset += chunk.dataSize;
 
-		vdxFile.chunks.push_back(chunk);
+		vdxFile.chunks.push_back(std::move(chunk));
 	}
 
 	return vdxFile;
 }
 
+//
+// Parse a VDX file that was read into its own buffer, taking ownership of it
+//
+VDXFile parseVDXFile(const std::string& filename, std::vector<uint8_t> buffer)
+{
+	auto owned = std::make_shared<const std::vector<uint8_t>>(std::move(buffer));
+	return parseVDXFile(filename, *owned, owned);
+}
+
+/*
+===============================================================================
+Function Name: maxDecompressedSize
+
+Description:
+	- Upper bound on the LZSS-decompressed size of a 640x320 frame chunk, so
+	the stream can be decoded straight into a preallocated buffer.
+
+Parameters:
+	- chunkType: VDX chunk type.
+
+Return:
+	- Size in bytes, or 0 if the chunk type has no fixed bound.
+
+Notes:
+	- 0x20: tile header, 256-colour palette, 4 bytes per 4x4 tile.
+	- 0x25: palette header and colours, a line skip per tile row, and the
+	longest opcode (0x60, 17 bytes) for every tile.
+===============================================================================
+*/
+size_t maxDecompressedSize(uint8_t chunkType)
+{
+	constexpr size_t tiles = (640 / 4) * (320 / 4);
+
+	switch (chunkType)
+	{
+	case 0x20:
+		return 6 + 256 * 3 + tiles * 4;
+	case 0x25:
+		return 2 + 32 + 256 * 3 + (320 / 4) + tiles * 17;
+	default:
+		return 0;
+	}
+}
+
+//
+// Payload of a 0x20/0x25 chunk, LZSS-decompressed into scratch if needed.
+// scratch must hold at least maxDecompressedSize(0x25) bytes.
+//
+static std::span<const uint8_t> framePayload(const VDXChunk& chunk, std::vector<uint8_t>& scratch)
+{
+	if (chunk.lengthBits == 0)
+		return chunk.raw;
+
+	ScopedTimer timer(ProfileScope::LZSS);
+	const size_t size = lzssDecompress(chunk.raw, chunk.lengthMask, chunk.lengthBits,
+		std::span<uint8_t>(scratch.data(), maxDecompressedSize(chunk.chunkType)));
+
+	return { scratch.data(), size };
+}
+
 /*
 ===============================================================================
 Function Name: parseVDXChunks
@@ -83,13 +150,28 @@ void parseVDXChunks(VDXFile& vdxFile)
 	size_t prevBitmapIndex{};
 	RGBColor colorKey = { 255, 0, 255 }; // Fuscia
 
+	// One scratch buffer, sized for the largest frame chunk, serves every
+	// LZSS stream in the file
+	std::vector<uint8_t> scratch(maxDecompressedSize(0x25));
+
 	for (size_t i = 0; i < vdxFile.chunks.size(); i++)
 	{
 		VDXChunk& chunk = vdxFile.chunks[i];
+		std::span<const uint8_t> chunkData = chunk.raw;
 
 		if (chunk.lengthBits != 0)
 		{
-			chunk.data = lzssDecompress(chunk.data, chunk.lengthMask, chunk.lengthBits);
+			const size_t bound = maxDecompressedSize(chunk.chunkType);
+
+			if (bound == 0)
+			{
+				chunk.data = lzssDecompress(chunk.raw, chunk.lengthMask, chunk.lengthBits);
+				chunkData = chunk.data;
+			}
+			else
+			{
+				chunkData = framePayload(chunk, scratch);
+			}
 		}
 
 		switch (chunk.chunkType)
@@ -108,8 +190,8 @@ void parseVDXChunks(VDXFile& vdxFile)
 			}
 
 			auto [palData, bitmapData] = chunk.chunkType == 0x20
-				? getBitmapData(chunk.data)
-				: getDeltaBitmapData(chunk.data, palette, config["devMode"] ? alphaChannel : vdxFile.chunks[prevBitmapIndex].data);
+				? getBitmapData(chunkData)
+				: getDeltaBitmapData(chunkData, palette, config["devMode"] ? alphaChannel : vdxFile.chunks[prevBitmapIndex].data);
 
 			palette = palData;
 			chunk.data = bitmapData;
@@ -124,6 +206,154 @@ void parseVDXChunks(VDXFile& vdxFile)
 	}
 }
 
+/*
+===============================================================================
+Function Name: openVDXStream
+
+Description:
+	- Prepares an incremental decoder over the 0x20/0x25 frames of a VDX file.
+	Nothing is decoded until the first call to VDXStream::next().
+
+Parameters:
+	- vdxFile: Parsed VDXFile object. Must outlive the stream.
+	- deferTiles: Keep 0x20 frames as their raw tile stream (frame.tiles) for
+	a consumer that decodes tiles itself. They are expanded on the CPU only
+	when a following 0x25 frame has to be applied on top.
+
+Return:
+	- VDXStream positioned before the first frame.
+
+Notes:
+	- Only the current frame and palette are kept, so memory use does not
+	depend on the length of the clip. Frames stay 8-bit palette-indexed;
+	expanding to RGB/BGRA is left to whoever consumes them.
+===============================================================================
+*/
+VDXStream openVDXStream(const VDXFile& vdxFile, bool deferTiles)
+{
+	VDXStream stream;
+	stream.vdxFile = &vdxFile;
+	stream.deferTiles = deferTiles;
+	stream.frame.resize(640, 320);
+	stream.scratch.resize(maxDecompressedSize(0x25));
+
+	return stream;
+}
+
+//
+// Decode the next frame into frameBuffer; false once the clip is exhausted
+//
+bool VDXStream::next()
+{
+	while (vdxFile && nextChunk < vdxFile->chunks.size())
+	{
+		const VDXChunk& chunk = vdxFile->chunks[nextChunk++];
+
+		if (chunk.chunkType != 0x20 && chunk.chunkType != 0x25)
+			continue;
+
+		std::span<const uint8_t> chunkData = framePayload(chunk, scratch);
+
+		dirty.clear();
+
+		if (chunk.chunkType == 0x20)
+		{
+			ScopedTimer timer(ProfileScope::Bitmap);
+
+			if (deferTiles)
+				getBitmapTiles(chunkData, frame);
+			else
+				getBitmapIndices(chunkData, frame);
+
+			dirty.markAll();
+		}
+		else
+		{
+			ScopedTimer timer(ProfileScope::Delta);
+
+			// Deltas need real pixels to apply to
+			if (!frame.tiles.empty())
+				expandBitmapTiles(frame);
+
+			applyDeltaIndices(chunkData, frame, &dirty);
+		}
+
+		++framesDecoded;
+
+		return true;
+	}
+
+	return false;
+}
+
+//
+// Number of displayable (0x20/0x25) frames in a VDX file
+//
+size_t countVDXFrames(const VDXFile& vdxFile)
+{
+	return std::ranges::count_if(vdxFile.chunks, [](const VDXChunk& chunk) {
+		return chunk.chunkType == 0x20 || chunk.chunkType == 0x25;
+		});
+}
+
+/*
+===============================================================================
+Function Name: packVDXFile
+
+Description:
+	- Builds a VDX clip from RGB frames, ready for writeVDXFile. The first
+	frame becomes a 0x20 bitmap and every later frame a 0x25 delta against
+	what the decoder will be showing at that point, so the clip keeps the
+	size and decode cost of an original rather than storing full frames.
+
+Parameters:
+	- filename: Name of the VDX file, as written by writeVDXFile
+	- frames: 8-bit RGB raw bitmap data, width * height * 3 bytes each
+	- palette: Palette for the whole clip (1 to 256 colours)
+	- width, height: Frame size; a multiple of 4 in both directions
+
+Return:
+	- VDXFile: LZSS-compressed chunks; their raw bytes live in storage
+
+Notes:
+	- Chunks are compressed with the 0x0F/4 length parameters the original
+	clips use. Audio (0x80) chunks are not produced.
+===============================================================================
+*/
+VDXFile packVDXFile(const std::string& filename, const std::vector<std::vector<uint8_t>>& frames,
+	const std::vector<RGBColor>& palette, int width, int height)
+{
+	constexpr uint8_t lengthMask = 0x0F, lengthBits = 4;
+
+	VDXFile vdxFile{ filename, 0x6792, {}, {}, nullptr, false };
+	auto payloads = std::make_shared<std::vector<std::vector<uint8_t>>>();
+	payloads->reserve(frames.size());
+
+	IndexedFrame frame;
+
+	for (size_t i = 0; i < frames.size(); ++i)
+	{
+		std::vector<uint8_t> data;
+
+		if (i == 0)
+		{
+			data = packBitmapData(frames[i], palette, width, height);
+			getBitmapIndices(data, frame);
+		}
+		else
+		{
+			data = packDeltaBitmapData(frames[i], palette, frame);
+		}
+
+		const auto& payload = payloads->emplace_back(lzssCompress(data, lengthMask, lengthBits));
+		vdxFile.chunks.push_back({ static_cast<uint8_t>(i == 0 ? 0x20 : 0x25), 0, static_cast<uint32_t>(payload.size()),
+			lengthMask, lengthBits, payload, {} });
+	}
+
+	vdxFile.storage = std::move(payloads);
+	return vdxFile;
+}
+
 /*
 ===============================================================================
 Function Name: writeVDXFile
@@ -159,7 +389,7 @@ void writeVDXFile(const VDXFile& vdxFile, const std::string& outputDir)
 		vdxFileOut.write(reinterpret_cast<const char*>(&chunk.lengthBits), sizeof(chunk.lengthBits));
 
 		// Write chunk data
-		vdxFileOut.write(reinterpret_cast<const char*>(chunk.data.data()), chunk.data.size());
+		vdxFileOut.write(reinterpret_cast<const char*>(chunk.raw.data()), chunk.raw.size());
 	}
 
 	vdxFileOut.close();
@@ -2,12 +2,22 @@
 
 #include <stdexcept>
 #include <array>
+#include <algorithm>
+#include <cstring>
+#include <vector>
 
 #include "vulkan.h"
+#include "window.h"
 #include "game.h"
+#include "pixel.h"
+#include "profiler.h"
+
+// Generated from shaders/ by the pre-build step
+#include "../shaders/vert.h"
+#include "../shaders/frag.h"
+#include "../shaders/comp.h"
 
 static VulkanContext ctx;
-static VkCommandBuffer commandBuffer;
 
 //
 // Find a suitable memory type
@@ -71,12 +81,22 @@ void initializeVulkan() {
 	createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
 	createInfo.pApplicationInfo = &appInfo;
 
-	std::vector<const char*> extensions = { VK_KHR_SURFACE_EXTENSION_NAME };
+	std::vector<const char*> extensions = { VK_KHR_SURFACE_EXTENSION_NAME, VK_KHR_WIN32_SURFACE_EXTENSION_NAME };
 	createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
 	createInfo.ppEnabledExtensionNames = extensions.data();
 
 	vkCreateInstance(&createInfo, nullptr, &ctx.instance);
 
+	// Surface
+	VkWin32SurfaceCreateInfoKHR surfaceInfo{};
+	surfaceInfo.sType = VK_STRUCTURE_TYPE_WIN32_SURFACE_CREATE_INFO_KHR;
+	surfaceInfo.hwnd = hwnd;
+	surfaceInfo.hinstance = GetModuleHandle(nullptr);
+
+	if (vkCreateWin32SurfaceKHR(ctx.instance, &surfaceInfo, nullptr, &ctx.surface) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create window surface");
+	}
+
 	// Physical device
 	uint32_t deviceCount = 0;
 	vkEnumeratePhysicalDevices(ctx.instance, &deviceCount, nullptr);
@@ -90,13 +110,23 @@ void initializeVulkan() {
 	std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
 	vkGetPhysicalDeviceQueueFamilyProperties(ctx.physicalDevice, &queueFamilyCount, queueFamilies.data());
 
+	// The same family draws and presents, so no ownership transfers are needed
+	bool foundQueueFamily = false;
 	for (uint32_t i = 0; i < queueFamilyCount; i++) {
-		if (queueFamilies[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+		VkBool32 presentSupport = VK_FALSE;
+		vkGetPhysicalDeviceSurfaceSupportKHR(ctx.physicalDevice, i, ctx.surface, &presentSupport);
+
+		if ((queueFamilies[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) && presentSupport) {
 			ctx.graphicsQueueFamily = i;
+			foundQueueFamily = true;
 			break;
 		}
 	}
 
+	if (!foundQueueFamily) {
+		throw std::runtime_error("No queue family supports both graphics and present");
+	}
+
 	// Logical device
 	float queuePriority = 1.0f;
 	VkDeviceQueueCreateInfo queueCreateInfo{};
@@ -105,14 +135,29 @@ void initializeVulkan() {
 	queueCreateInfo.queueCount = 1;
 	queueCreateInfo.pQueuePriorities = &queuePriority;
 
+	// Tile decoding writes the R8_UINT texture as a storage image, which is an optional feature
+	VkPhysicalDeviceFeatures supportedFeatures;
+	vkGetPhysicalDeviceFeatures(ctx.physicalDevice, &supportedFeatures);
+
+	VkFormatProperties indexFormat;
+	vkGetPhysicalDeviceFormatProperties(ctx.physicalDevice, VK_FORMAT_R8_UINT, &indexFormat);
+
+	ctx.tileDecode = config.value("gpuTileDecode", true) &&
+		supportedFeatures.shaderStorageImageExtendedFormats &&
+		(indexFormat.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT);
+
 	VkPhysicalDeviceFeatures deviceFeatures{};
+	deviceFeatures.shaderStorageImageExtendedFormats = ctx.tileDecode ? VK_TRUE : VK_FALSE;
+
+	const std::array<const char*, 1> deviceExtensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
 
 	VkDeviceCreateInfo deviceInfo{};
 	deviceInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 	deviceInfo.queueCreateInfoCount = 1;
 	deviceInfo.pQueueCreateInfos = &queueCreateInfo;
 	deviceInfo.pEnabledFeatures = &deviceFeatures;
-	deviceInfo.enabledExtensionCount = 0;
+	deviceInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
+	deviceInfo.ppEnabledExtensionNames = deviceExtensions.data();
 
 	vkCreateDevice(ctx.physicalDevice, &deviceInfo, nullptr, &ctx.device);
 	vkGetDeviceQueue(ctx.device, ctx.graphicsQueueFamily, 0, &ctx.graphicsQueue);
@@ -126,16 +171,555 @@ void initializeVulkan() {
 
 	// Create initial texture
 	createVulkanTexture(nullptr, MIN_CLIENT_WIDTH, MIN_CLIENT_HEIGHT);
+
+	createSwapchain();
+	createRenderPass();
+	createFramebuffers();
+	createDescriptors();
+	createGraphicsPipeline();
+	createUploadRing();
+
+	if (ctx.tileDecode) {
+		createTilePipeline();
+	}
+
+	// Clips decoded from here on keep their 0x20 frames as tiles for us
+	state.gpuTileDecode = ctx.tileDecode;
+}
+
+//
+// Create the swapchain and one view per image
+//
+void createSwapchain() {
+	VkSurfaceCapabilitiesKHR capabilities;
+	vkGetPhysicalDeviceSurfaceCapabilitiesKHR(ctx.physicalDevice, ctx.surface, &capabilities);
+
+	uint32_t formatCount = 0;
+	vkGetPhysicalDeviceSurfaceFormatsKHR(ctx.physicalDevice, ctx.surface, &formatCount, nullptr);
+	std::vector<VkSurfaceFormatKHR> formats(formatCount);
+	vkGetPhysicalDeviceSurfaceFormatsKHR(ctx.physicalDevice, ctx.surface, &formatCount, formats.data());
+
+	VkSurfaceFormatKHR surfaceFormat = formats[0];
+	for (const VkSurfaceFormatKHR& format : formats) {
+		if (format.format == VK_FORMAT_B8G8R8A8_UNORM && format.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR) {
+			surfaceFormat = format;
+			break;
+		}
+	}
+
+	// Win32 always reports the client size; fall back to the window state if it does not
+	VkExtent2D extent = capabilities.currentExtent;
+	if (extent.width == UINT32_MAX) {
+		extent.width = std::clamp(static_cast<uint32_t>(state.ui.width), capabilities.minImageExtent.width, capabilities.maxImageExtent.width);
+		extent.height = std::clamp(static_cast<uint32_t>(state.ui.height), capabilities.minImageExtent.height, capabilities.maxImageExtent.height);
+	}
+
+	uint32_t imageCount = capabilities.minImageCount + 1;
+	if (capabilities.maxImageCount > 0 && imageCount > capabilities.maxImageCount) {
+		imageCount = capabilities.maxImageCount;
+	}
+
+	VkSwapchainCreateInfoKHR createInfo{};
+	createInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
+	createInfo.surface = ctx.surface;
+	createInfo.minImageCount = imageCount;
+	createInfo.imageFormat = surfaceFormat.format;
+	createInfo.imageColorSpace = surfaceFormat.colorSpace;
+	createInfo.imageExtent = extent;
+	createInfo.imageArrayLayers = 1;
+	createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+	createInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	createInfo.preTransform = capabilities.currentTransform;
+	createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+	createInfo.presentMode = VK_PRESENT_MODE_FIFO_KHR;
+	createInfo.clipped = VK_TRUE;
+	createInfo.oldSwapchain = VK_NULL_HANDLE;
+
+	if (vkCreateSwapchainKHR(ctx.device, &createInfo, nullptr, &ctx.swapchain) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create swapchain");
+	}
+
+	ctx.swapchainFormat = surfaceFormat.format;
+	ctx.swapchainExtent = extent;
+
+	vkGetSwapchainImagesKHR(ctx.device, ctx.swapchain, &imageCount, nullptr);
+	ctx.swapchainImages.resize(imageCount);
+	vkGetSwapchainImagesKHR(ctx.device, ctx.swapchain, &imageCount, ctx.swapchainImages.data());
+
+	ctx.swapchainImageViews.resize(imageCount);
+	for (uint32_t i = 0; i < imageCount; i++) {
+		VkImageViewCreateInfo viewInfo{};
+		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		viewInfo.image = ctx.swapchainImages[i];
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format = ctx.swapchainFormat;
+		viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		viewInfo.subresourceRange.baseMipLevel = 0;
+		viewInfo.subresourceRange.levelCount = 1;
+		viewInfo.subresourceRange.baseArrayLayer = 0;
+		viewInfo.subresourceRange.layerCount = 1;
+
+		if (vkCreateImageView(ctx.device, &viewInfo, nullptr, &ctx.swapchainImageViews[i]) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create swapchain image view");
+		}
+	}
+}
+
+//
+// Create a single-subpass render pass that clears and presents
+//
+void createRenderPass() {
+	VkAttachmentDescription colorAttachment{};
+	colorAttachment.format = ctx.swapchainFormat;
+	colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+	colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+	VkAttachmentReference colorRef{};
+	colorRef.attachment = 0;
+	colorRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+	VkSubpassDescription subpass{};
+	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	subpass.colorAttachmentCount = 1;
+	subpass.pColorAttachments = &colorRef;
+
+	// Wait for the acquired image before writing to it
+	VkSubpassDependency dependency{};
+	dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+	dependency.dstSubpass = 0;
+	dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	dependency.srcAccessMask = 0;
+	dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+	VkRenderPassCreateInfo renderPassInfo{};
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+	renderPassInfo.attachmentCount = 1;
+	renderPassInfo.pAttachments = &colorAttachment;
+	renderPassInfo.subpassCount = 1;
+	renderPassInfo.pSubpasses = &subpass;
+	renderPassInfo.dependencyCount = 1;
+	renderPassInfo.pDependencies = &dependency;
+
+	if (vkCreateRenderPass(ctx.device, &renderPassInfo, nullptr, &ctx.renderPass) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create render pass");
+	}
+}
+
+//
+// Create one framebuffer per swapchain image
+//
+void createFramebuffers() {
+	ctx.framebuffers.resize(ctx.swapchainImageViews.size());
+
+	for (size_t i = 0; i < ctx.swapchainImageViews.size(); i++) {
+		VkFramebufferCreateInfo framebufferInfo{};
+		framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+		framebufferInfo.renderPass = ctx.renderPass;
+		framebufferInfo.attachmentCount = 1;
+		framebufferInfo.pAttachments = &ctx.swapchainImageViews[i];
+		framebufferInfo.width = ctx.swapchainExtent.width;
+		framebufferInfo.height = ctx.swapchainExtent.height;
+		framebufferInfo.layers = 1;
+
+		if (vkCreateFramebuffer(ctx.device, &framebufferInfo, nullptr, &ctx.framebuffers[i]) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create framebuffer");
+		}
+	}
+}
+
+//
+// Create the palette buffer and the descriptor set binding it with the index texture
+//
+void createDescriptors() {
+	createBuffer(PALETTE_SIZE, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, ctx.paletteBuffer, ctx.paletteBufferMemory);
+
+	std::array<VkDescriptorSetLayoutBinding, 2> bindings{};
+	bindings[0].binding = 0;
+	bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	bindings[0].descriptorCount = 1;
+	bindings[0].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+	bindings[1].binding = 1;
+	bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	bindings[1].descriptorCount = 1;
+	bindings[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo{};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+	layoutInfo.pBindings = bindings.data();
+
+	if (vkCreateDescriptorSetLayout(ctx.device, &layoutInfo, nullptr, &ctx.descriptorSetLayout) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create descriptor set layout");
+	}
+
+	std::array<VkDescriptorPoolSize, 2> poolSizes{};
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	poolSizes[0].descriptorCount = 1;
+	poolSizes[1].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	poolSizes[1].descriptorCount = 1;
+
+	VkDescriptorPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.maxSets = 1;
+	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+	poolInfo.pPoolSizes = poolSizes.data();
+
+	if (vkCreateDescriptorPool(ctx.device, &poolInfo, nullptr, &ctx.descriptorPool) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create descriptor pool");
+	}
+
+	VkDescriptorSetAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = ctx.descriptorPool;
+	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts = &ctx.descriptorSetLayout;
+
+	if (vkAllocateDescriptorSets(ctx.device, &allocInfo, &ctx.descriptorSet) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to allocate descriptor set");
+	}
+
+	VkDescriptorImageInfo imageInfo{};
+	imageInfo.sampler = ctx.textureSampler;
+	imageInfo.imageView = ctx.textureImageView;
+	imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	VkDescriptorBufferInfo bufferInfo{};
+	bufferInfo.buffer = ctx.paletteBuffer;
+	bufferInfo.offset = 0;
+	bufferInfo.range = PALETTE_SIZE;
+
+	std::array<VkWriteDescriptorSet, 2> writes{};
+	writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	writes[0].dstSet = ctx.descriptorSet;
+	writes[0].dstBinding = 0;
+	writes[0].descriptorCount = 1;
+	writes[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	writes[0].pImageInfo = &imageInfo;
+	writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	writes[1].dstSet = ctx.descriptorSet;
+	writes[1].dstBinding = 1;
+	writes[1].descriptorCount = 1;
+	writes[1].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	writes[1].pBufferInfo = &bufferInfo;
+
+	vkUpdateDescriptorSets(ctx.device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+}
+
+//
+// Create a shader module from embedded SPIR-V
+//
+static VkShaderModule createShaderModule(const uint32_t* code, size_t size) {
+	VkShaderModuleCreateInfo createInfo{};
+	createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	createInfo.codeSize = size;
+	createInfo.pCode = code;
+
+	VkShaderModule shaderModule;
+	if (vkCreateShaderModule(ctx.device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create shader module");
+	}
+
+	return shaderModule;
+}
+
+//
+// Create the fullscreen-triangle pipeline that expands indices through the palette
+//
+void createGraphicsPipeline() {
+	VkShaderModule vertModule = createShaderModule(vertShaderCode, sizeof(vertShaderCode));
+	VkShaderModule fragModule = createShaderModule(fragShaderCode, sizeof(fragShaderCode));
+
+	std::array<VkPipelineShaderStageCreateInfo, 2> stages{};
+	stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+	stages[0].module = vertModule;
+	stages[0].pName = "main";
+	stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+	stages[1].module = fragModule;
+	stages[1].pName = "main";
+
+	// Vertices are generated from gl_VertexIndex
+	VkPipelineVertexInputStateCreateInfo vertexInput{};
+	vertexInput.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+
+	VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+	inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+	inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+	// Viewport and scissor are set per frame so resizing never rebuilds the pipeline
+	VkPipelineViewportStateCreateInfo viewportState{};
+	viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	viewportState.viewportCount = 1;
+	viewportState.scissorCount = 1;
+
+	VkPipelineRasterizationStateCreateInfo rasterizer{};
+	rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+	rasterizer.cullMode = VK_CULL_MODE_NONE;
+	rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+	rasterizer.lineWidth = 1.0f;
+
+	VkPipelineMultisampleStateCreateInfo multisampling{};
+	multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+	VkPipelineColorBlendAttachmentState blendAttachment{};
+	blendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+		VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+	blendAttachment.blendEnable = VK_FALSE;
+
+	VkPipelineColorBlendStateCreateInfo colorBlending{};
+	colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	colorBlending.attachmentCount = 1;
+	colorBlending.pAttachments = &blendAttachment;
+
+	const std::array<VkDynamicState, 2> dynamicStates = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+
+	VkPipelineDynamicStateCreateInfo dynamicState{};
+	dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+	dynamicState.pDynamicStates = dynamicStates.data();
+
+	VkPipelineLayoutCreateInfo layoutInfo{};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	layoutInfo.setLayoutCount = 1;
+	layoutInfo.pSetLayouts = &ctx.descriptorSetLayout;
+
+	if (vkCreatePipelineLayout(ctx.device, &layoutInfo, nullptr, &ctx.pipelineLayout) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create pipeline layout");
+	}
+
+	VkGraphicsPipelineCreateInfo pipelineInfo{};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	pipelineInfo.stageCount = static_cast<uint32_t>(stages.size());
+	pipelineInfo.pStages = stages.data();
+	pipelineInfo.pVertexInputState = &vertexInput;
+	pipelineInfo.pInputAssemblyState = &inputAssembly;
+	pipelineInfo.pViewportState = &viewportState;
+	pipelineInfo.pRasterizationState = &rasterizer;
+	pipelineInfo.pMultisampleState = &multisampling;
+	pipelineInfo.pColorBlendState = &colorBlending;
+	pipelineInfo.pDynamicState = &dynamicState;
+	pipelineInfo.layout = ctx.pipelineLayout;
+	pipelineInfo.renderPass = ctx.renderPass;
+	pipelineInfo.subpass = 0;
+
+	if (vkCreateGraphicsPipelines(ctx.device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &ctx.graphicsPipeline) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create graphics pipeline");
+	}
+
+	vkDestroyShaderModule(ctx.device, fragModule, nullptr);
+	vkDestroyShaderModule(ctx.device, vertModule, nullptr);
+}
+
+//
+// Destroy the swapchain and everything sized to it
+//
+static void destroySwapchain() {
+	for (VkFramebuffer framebuffer : ctx.framebuffers) {
+		vkDestroyFramebuffer(ctx.device, framebuffer, nullptr);
+	}
+	for (VkImageView view : ctx.swapchainImageViews) {
+		vkDestroyImageView(ctx.device, view, nullptr);
+	}
+	ctx.framebuffers.clear();
+	ctx.swapchainImageViews.clear();
+	ctx.swapchainImages.clear();
+
+	vkDestroySwapchainKHR(ctx.device, ctx.swapchain, nullptr);
+	ctx.swapchain = VK_NULL_HANDLE;
+}
+
+//
+// Rebuild the swapchain after a resize; the render pass and pipeline are size-independent
+//
+void recreateSwapchain() {
+	vkDeviceWaitIdle(ctx.device);
+
+	destroySwapchain();
+	createSwapchain();
+	createFramebuffers();
+
+	state.dirty.markAll();
+}
+
+//
+// Create the staging ring: one mapped buffer, command buffer, fence and semaphore pair per frame in flight
+//
+void createUploadRing() {
+	const VkDeviceSize stagingSize = INDEX_PLANE_SIZE + PALETTE_SIZE;
+
+	std::array<VkCommandBuffer, MAX_FRAMES_IN_FLIGHT> commandBuffers;
+
+	VkCommandBufferAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocInfo.commandPool = ctx.commandPool;
+	allocInfo.commandBufferCount = MAX_FRAMES_IN_FLIGHT;
+
+	if (vkAllocateCommandBuffers(ctx.device, &allocInfo, commandBuffers.data()) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to allocate upload command buffers");
+	}
+
+	// Fences start signalled so the first use of each slot does not wait
+	VkFenceCreateInfo fenceInfo{};
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+	VkSemaphoreCreateInfo semaphoreInfo{};
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+	for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+		VulkanUploadSlot& slot = ctx.uploads[i];
+
+		createBuffer(stagingSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			slot.stagingBuffer, slot.stagingMemory);
+
+		vkMapMemory(ctx.device, slot.stagingMemory, 0, stagingSize, 0, &slot.mapped);
+
+		slot.commandBuffer = commandBuffers[i];
+
+		if (vkCreateFence(ctx.device, &fenceInfo, nullptr, &slot.fence) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create upload fence");
+		}
+
+		if (vkCreateSemaphore(ctx.device, &semaphoreInfo, nullptr, &slot.imageAvailable) != VK_SUCCESS ||
+			vkCreateSemaphore(ctx.device, &semaphoreInfo, nullptr, &slot.renderFinished) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to create frame semaphores");
+		}
+	}
+
+	ctx.currentUpload = 0;
 }
 
 //
-// Create a texture from pixel data
+// Create the compute pipeline that decodes 0x20 tile streams into the index texture
+//
+void createTilePipeline() {
+	std::array<VkDescriptorSetLayoutBinding, 2> bindings{};
+	bindings[0].binding = 0;
+	bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	bindings[0].descriptorCount = 1;
+	bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	bindings[1].binding = 1;
+	bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	bindings[1].descriptorCount = 1;
+	bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo{};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+	layoutInfo.pBindings = bindings.data();
+
+	if (vkCreateDescriptorSetLayout(ctx.device, &layoutInfo, nullptr, &ctx.tileDescriptorSetLayout) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create tile descriptor set layout");
+	}
+
+	std::array<VkDescriptorPoolSize, 2> poolSizes{};
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	poolSizes[0].descriptorCount = MAX_FRAMES_IN_FLIGHT;
+	poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSizes[1].descriptorCount = MAX_FRAMES_IN_FLIGHT;
+
+	VkDescriptorPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.maxSets = MAX_FRAMES_IN_FLIGHT;
+	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+	poolInfo.pPoolSizes = poolSizes.data();
+
+	if (vkCreateDescriptorPool(ctx.device, &poolInfo, nullptr, &ctx.tileDescriptorPool) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create tile descriptor pool");
+	}
+
+	// One set per upload slot, since each reads the tile stream from its own staging buffer
+	for (VulkanUploadSlot& slot : ctx.uploads) {
+		VkDescriptorSetAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.descriptorPool = ctx.tileDescriptorPool;
+		allocInfo.descriptorSetCount = 1;
+		allocInfo.pSetLayouts = &ctx.tileDescriptorSetLayout;
+
+		if (vkAllocateDescriptorSets(ctx.device, &allocInfo, &slot.tileDescriptorSet) != VK_SUCCESS) {
+			throw std::runtime_error("Failed to allocate tile descriptor set");
+		}
+
+		VkDescriptorImageInfo imageInfo{};
+		imageInfo.imageView = ctx.textureImageView;
+		imageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+		VkDescriptorBufferInfo bufferInfo{};
+		bufferInfo.buffer = slot.stagingBuffer;
+		bufferInfo.offset = 0;
+		bufferInfo.range = INDEX_PLANE_SIZE / 4;	// 4 bytes per 4x4 tile
+
+		std::array<VkWriteDescriptorSet, 2> writes{};
+		writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[0].dstSet = slot.tileDescriptorSet;
+		writes[0].dstBinding = 0;
+		writes[0].descriptorCount = 1;
+		writes[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		writes[0].pImageInfo = &imageInfo;
+		writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[1].dstSet = slot.tileDescriptorSet;
+		writes[1].dstBinding = 1;
+		writes[1].descriptorCount = 1;
+		writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		writes[1].pBufferInfo = &bufferInfo;
+
+		vkUpdateDescriptorSets(ctx.device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+	}
+
+	VkPushConstantRange pushConstant{};
+	pushConstant.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstant.offset = 0;
+	pushConstant.size = sizeof(uint32_t);
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &ctx.tileDescriptorSetLayout;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstant;
+
+	if (vkCreatePipelineLayout(ctx.device, &pipelineLayoutInfo, nullptr, &ctx.tilePipelineLayout) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create tile pipeline layout");
+	}
+
+	VkShaderModule compModule = createShaderModule(compShaderCode, sizeof(compShaderCode));
+
+	VkComputePipelineCreateInfo pipelineInfo{};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineInfo.stage.module = compModule;
+	pipelineInfo.stage.pName = "main";
+	pipelineInfo.layout = ctx.tilePipelineLayout;
+
+	if (vkCreateComputePipelines(ctx.device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &ctx.tilePipeline) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create tile pipeline");
+	}
+
+	vkDestroyShaderModule(ctx.device, compModule, nullptr);
+}
+
+//
+// Create the palette-index texture; pixels are expanded in the fragment shader
 //
 void createVulkanTexture(const uint8_t* pixels, uint32_t width, uint32_t height) {
 	VkImageCreateInfo imageInfo{};
 	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
 	imageInfo.imageType = VK_IMAGE_TYPE_2D;
-	imageInfo.format = VK_FORMAT_B8G8R8A8_UNORM;
+	imageInfo.format = VK_FORMAT_R8_UINT;
 	imageInfo.extent.width = width;
 	imageInfo.extent.height = height;
 	imageInfo.extent.depth = 1;
@@ -144,10 +728,14 @@ void createVulkanTexture(const uint8_t* pixels, uint32_t width, uint32_t height)
 	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
 	imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
 	imageInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	if (ctx.tileDecode) {
+		imageInfo.usage |= VK_IMAGE_USAGE_STORAGE_BIT;
+	}
 	imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 	imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 
 	vkCreateImage(ctx.device, &imageInfo, nullptr, &ctx.textureImage);
+	ctx.textureLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 
 	VkMemoryRequirements memRequirements;
 	vkGetImageMemoryRequirements(ctx.device, ctx.textureImage, &memRequirements);
@@ -165,7 +753,7 @@ void createVulkanTexture(const uint8_t* pixels, uint32_t width, uint32_t height)
 	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
 	viewInfo.image = ctx.textureImage;
 	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-	viewInfo.format = VK_FORMAT_B8G8R8A8_UNORM;
+	viewInfo.format = VK_FORMAT_R8_UINT;
 	viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 	viewInfo.subresourceRange.baseMipLevel = 0;
 	viewInfo.subresourceRange.levelCount = 1;
@@ -195,89 +783,331 @@ void createVulkanTexture(const uint8_t* pixels, uint32_t width, uint32_t height)
 	vkCreateSampler(ctx.device, &samplerInfo, nullptr, &ctx.textureSampler);
 }
 
+//
+// Record a layout transition of the index texture
+//
+static void transitionTexture(VkCommandBuffer commandBuffer, VkImageLayout newLayout,
+	VkAccessFlags srcAccess, VkAccessFlags dstAccess, VkPipelineStageFlags srcStage, VkPipelineStageFlags dstStage) {
+	VkImageMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.oldLayout = ctx.textureLayout;
+	barrier.newLayout = newLayout;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = ctx.textureImage;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.baseMipLevel = 0;
+	barrier.subresourceRange.levelCount = 1;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount = 1;
+	barrier.srcAccessMask = srcAccess;
+	barrier.dstAccessMask = dstAccess;
+
+	vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+	ctx.textureLayout = newLayout;
+}
+
+//
+// Profiler overlay (devMode): its rectangles are cleared straight into the
+// swapchain image inside the render pass, one call per run of one colour
+//
+static void drawOverlayVk(VkCommandBuffer commandBuffer) {
+	const std::vector<OverlayRect> rects = buildProfilerOverlay();
+	std::vector<VkClearRect> batch;
+
+	for (size_t i = 0; i < rects.size(); ++i) {
+		const OverlayRect& rect = rects[i];
+
+		// Clear rects must lie inside the render area
+		const int32_t x = std::max(rect.x, 0);
+		const int32_t y = std::max(rect.y, 0);
+		const int32_t right = std::min<int32_t>(rect.x + rect.width, ctx.swapchainExtent.width);
+		const int32_t bottom = std::min<int32_t>(rect.y + rect.height, ctx.swapchainExtent.height);
+
+		if (right > x && bottom > y) {
+			VkClearRect clearRect{};
+			clearRect.rect.offset = { x, y };
+			clearRect.rect.extent = { static_cast<uint32_t>(right - x), static_cast<uint32_t>(bottom - y) };
+			clearRect.baseArrayLayer = 0;
+			clearRect.layerCount = 1;
+			batch.push_back(clearRect);
+		}
+
+		if (!batch.empty() && (i + 1 == rects.size() || rects[i + 1].color != rect.color)) {
+			VkClearAttachment attachment{};
+			attachment.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			attachment.colorAttachment = 0;
+			attachment.clearValue.color = { {
+				((rect.color >> 16) & 0xFF) / 255.0f, ((rect.color >> 8) & 0xFF) / 255.0f, (rect.color & 0xFF) / 255.0f, 1.0f } };
+
+			vkCmdClearAttachments(commandBuffer, 1, &attachment, static_cast<uint32_t>(batch.size()), batch.data());
+			batch.clear();
+		}
+	}
+}
+
 //
 // Render a frame using Vulkan
 //
 void renderFrameVk() {
-	// Convert RGB to BGRA
-	std::span<const uint8_t> pixelData = state.currentVDX->chunks[state.currentFrameIndex].data;
-	std::vector<uint8_t> bgraData(MIN_CLIENT_WIDTH * MIN_CLIENT_HEIGHT * 4);
-
-	for (size_t i = 0, j = 0; i < pixelData.size(); i += 3, j += 4) {
-		bgraData[j] = pixelData[i + 2];     // Blue
-		bgraData[j + 1] = pixelData[i + 1]; // Green
-		bgraData[j + 2] = pixelData[i];     // Red
-		bgraData[j + 3] = 255;              // Alpha
+	const IndexedFrame* frame = currentFrame();
+	if (!frame || IsIconic(hwnd)) {
+		return;
 	}
 
-	// Update texture
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-	VkDeviceSize imageSize = MIN_CLIENT_WIDTH * MIN_CLIENT_HEIGHT * 4;
+	// Palette changes only touch the 1 KB palette buffer; indices upload by dirty region
+	const bool paletteChanged = state.dirty.palette;
+	DirtyTiles indexTiles = state.dirty;
+	indexTiles.palette = false;
 
-	createBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		stagingBuffer, stagingBufferMemory);
+	// Nothing dirty (WM_PAINT on a still view) skips the uploads but still
+	// draws and presents, which is also where a stale swapchain is noticed
+	const std::vector<PixelRect> rects = indexTiles.rects();
 
-	void* data;
-	vkMapMemory(ctx.device, stagingBufferMemory, 0, imageSize, 0, &data);
-	memcpy(data, bgraData.data(), static_cast<size_t>(imageSize));
-	vkUnmapMemory(ctx.device, stagingBufferMemory);
+	// Take the next slot of the ring, waiting only if the GPU still reads from it
+	VulkanUploadSlot& slot = ctx.uploads[ctx.currentUpload];
 
-	// Copy to texture
-	VkCommandBufferAllocateInfo allocInfo{};
-	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	allocInfo.commandPool = ctx.commandPool;
-	allocInfo.commandBufferCount = 1;
+	ScopedTimer acquireTimer(ProfileScope::Present);
+	vkWaitForFences(ctx.device, 1, &slot.fence, VK_TRUE, UINT64_MAX);
+
+	uint32_t imageIndex;
+	VkResult result = vkAcquireNextImageKHR(ctx.device, ctx.swapchain, UINT64_MAX,
+		slot.imageAvailable, VK_NULL_HANDLE, &imageIndex);
+
+	// Fence is still signalled here, so an early return leaves the slot usable
+	if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+		recreateSwapchain();
+		return;
+	}
+	if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
+		throw std::runtime_error("Failed to acquire swapchain image");
+	}
+
+	acquireTimer.stop();
+
+	vkResetFences(ctx.device, 1, &slot.fence);
+	ctx.currentUpload = (ctx.currentUpload + 1) % MAX_FRAMES_IN_FLIGHT;
 
-	VkCommandBuffer commandBuffer;
-	vkAllocateCommandBuffers(ctx.device, &allocInfo, &commandBuffer);
+	uint8_t* staging = static_cast<uint8_t*>(slot.mapped);
+
+	vkResetCommandBuffer(slot.commandBuffer, 0);
 
 	VkCommandBufferBeginInfo beginInfo{};
 	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
-	vkBeginCommandBuffer(commandBuffer, &beginInfo);
+	vkBeginCommandBuffer(slot.commandBuffer, &beginInfo);
+
+	// Until the submit; the palette conversion below nests inside it
+	ScopedTimer uploadTimer(ProfileScope::Upload);
 
-	VkBufferImageCopy region{};
-	region.bufferOffset = 0;
-	region.bufferRowLength = 0;
-	region.bufferImageHeight = 0;
-	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	region.imageSubresource.mipLevel = 0;
-	region.imageSubresource.baseArrayLayer = 0;
-	region.imageSubresource.layerCount = 1;
-	region.imageOffset = { 0, 0, 0 };
-	region.imageExtent = { static_cast<uint32_t>(MIN_CLIENT_WIDTH), static_cast<uint32_t>(MIN_CLIENT_HEIGHT), 1 };
+	if (!frame->tiles.empty() && !rects.empty()) {
+		// Keyframe still in tile form: 50 KB upload, decoded straight into the texture
+		std::memcpy(staging, frame->tiles.data(), frame->tiles.size());
 
-	vkCmdCopyBufferToImage(commandBuffer, stagingBuffer, ctx.textureImage,
-		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+		transitionTexture(slot.commandBuffer, VK_IMAGE_LAYOUT_GENERAL,
+			VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
 
-	vkEndCommandBuffer(commandBuffer);
+		const uint32_t tilesX = static_cast<uint32_t>(frame->width / 4);
+
+		vkCmdBindPipeline(slot.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, ctx.tilePipeline);
+		vkCmdBindDescriptorSets(slot.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, ctx.tilePipelineLayout,
+			0, 1, &slot.tileDescriptorSet, 0, nullptr);
+		vkCmdPushConstants(slot.commandBuffer, ctx.tilePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT,
+			0, sizeof(tilesX), &tilesX);
+		vkCmdDispatch(slot.commandBuffer, tilesX, static_cast<uint32_t>(frame->height / 4), 1);
+
+		transitionTexture(slot.commandBuffer, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+	}
+	else if (!rects.empty()) {
+		// Staging buffer is laid out like the frame, so each region keeps its offset
+		std::vector<VkBufferImageCopy> regions;
+		regions.reserve(rects.size());
+
+		for (const PixelRect& rect : rects) {
+			const size_t offset = static_cast<size_t>(rect.y) * MIN_CLIENT_WIDTH + rect.x;
+			for (int row = 0; row < rect.height; ++row) {
+				std::memcpy(staging + offset + static_cast<size_t>(row) * MIN_CLIENT_WIDTH,
+					frame->pixels.data() + offset + static_cast<size_t>(row) * MIN_CLIENT_WIDTH, rect.width);
+			}
+
+			VkBufferImageCopy region{};
+			region.bufferOffset = offset;
+			region.bufferRowLength = MIN_CLIENT_WIDTH;
+			region.bufferImageHeight = MIN_CLIENT_HEIGHT;
+			region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			region.imageSubresource.mipLevel = 0;
+			region.imageSubresource.baseArrayLayer = 0;
+			region.imageSubresource.layerCount = 1;
+			region.imageOffset = { rect.x, rect.y, 0 };
+			region.imageExtent = { static_cast<uint32_t>(rect.width), static_cast<uint32_t>(rect.height), 1 };
+			regions.push_back(region);
+		}
+
+		transitionTexture(slot.commandBuffer, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+		vkCmdCopyBufferToImage(slot.commandBuffer, slot.stagingBuffer, ctx.textureImage,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(regions.size()), regions.data());
+
+		transitionTexture(slot.commandBuffer, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+	}
+
+	if (paletteChanged) {
+		ScopedTimer convertTimer(ProfileScope::Convert);
+		const BGRALookup lut = buildBGRALookup(frame->palette);
+		std::memcpy(staging + INDEX_PLANE_SIZE, lut.data(), PALETTE_SIZE);
+		convertTimer.stop();
+
+		// Previous draws must finish reading the palette before it is overwritten
+		VkMemoryBarrier before{};
+		before.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		before.srcAccessMask = VK_ACCESS_UNIFORM_READ_BIT;
+		before.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		vkCmdPipelineBarrier(slot.commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+			0, 1, &before, 0, nullptr, 0, nullptr);
+
+		VkBufferCopy copy{};
+		copy.srcOffset = INDEX_PLANE_SIZE;
+		copy.dstOffset = 0;
+		copy.size = PALETTE_SIZE;
+		vkCmdCopyBuffer(slot.commandBuffer, slot.stagingBuffer, ctx.paletteBuffer, 1, &copy);
+
+		VkMemoryBarrier after{};
+		after.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		after.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		after.dstAccessMask = VK_ACCESS_UNIFORM_READ_BIT;
+		vkCmdPipelineBarrier(slot.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+			0, 1, &after, 0, nullptr, 0, nullptr);
+	}
+
+	// Draw the frame letterboxed at the 2:1 source aspect
+	VkClearValue clearColor{};
+	clearColor.color = { { 0.0f, 0.0f, 0.0f, 1.0f } };
+
+	VkRenderPassBeginInfo renderPassInfo{};
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassInfo.renderPass = ctx.renderPass;
+	renderPassInfo.framebuffer = ctx.framebuffers[imageIndex];
+	renderPassInfo.renderArea.offset = { 0, 0 };
+	renderPassInfo.renderArea.extent = ctx.swapchainExtent;
+	renderPassInfo.clearValueCount = 1;
+	renderPassInfo.pClearValues = &clearColor;
+
+	vkCmdBeginRenderPass(slot.commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+	vkCmdBindPipeline(slot.commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, ctx.graphicsPipeline);
+	vkCmdBindDescriptorSets(slot.commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, ctx.pipelineLayout,
+		0, 1, &ctx.descriptorSet, 0, nullptr);
+
+	const float width = static_cast<float>(ctx.swapchainExtent.width);
+	const float height = std::min(width / 2.0f, static_cast<float>(ctx.swapchainExtent.height));
+
+	VkViewport viewport{};
+	viewport.x = 0.0f;
+	viewport.y = (static_cast<float>(ctx.swapchainExtent.height) - height) / 2.0f;
+	viewport.width = width;
+	viewport.height = height;
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+	vkCmdSetViewport(slot.commandBuffer, 0, 1, &viewport);
+
+	VkRect2D scissor{};
+	scissor.offset = { 0, 0 };
+	scissor.extent = ctx.swapchainExtent;
+	vkCmdSetScissor(slot.commandBuffer, 0, 1, &scissor);
+
+	vkCmdDraw(slot.commandBuffer, 3, 1, 0, 0);
+	drawOverlayVk(slot.commandBuffer);
+	vkCmdEndRenderPass(slot.commandBuffer);
+
+	vkEndCommandBuffer(slot.commandBuffer);
+
+	const VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
 
 	VkSubmitInfo submitInfo{};
 	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.waitSemaphoreCount = 1;
+	submitInfo.pWaitSemaphores = &slot.imageAvailable;
+	submitInfo.pWaitDstStageMask = &waitStage;
 	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &commandBuffer;
+	submitInfo.pCommandBuffers = &slot.commandBuffer;
+	submitInfo.signalSemaphoreCount = 1;
+	submitInfo.pSignalSemaphores = &slot.renderFinished;
 
-	vkQueueSubmit(ctx.graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-	vkQueueWaitIdle(ctx.graphicsQueue);
+	// The fence paces the CPU instead of draining the queue every frame
+	if (vkQueueSubmit(ctx.graphicsQueue, 1, &submitInfo, slot.fence) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to submit frame");
+	}
+
+	uploadTimer.stop();
+	state.dirty.clear();
+
+	VkPresentInfoKHR presentInfo{};
+	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+	presentInfo.waitSemaphoreCount = 1;
+	presentInfo.pWaitSemaphores = &slot.renderFinished;
+	presentInfo.swapchainCount = 1;
+	presentInfo.pSwapchains = &ctx.swapchain;
+	presentInfo.pImageIndices = &imageIndex;
+
+	ScopedTimer presentTimer(ProfileScope::Present);
+	result = vkQueuePresentKHR(ctx.graphicsQueue, &presentInfo);
+	presentTimer.stop();
+
+	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
+		recreateSwapchain();
+	}
+	else if (result != VK_SUCCESS) {
+		throw std::runtime_error("Failed to present frame");
+	}
 
-	vkFreeCommandBuffers(ctx.device, ctx.commandPool, 1, &commandBuffer);
-	vkDestroyBuffer(ctx.device, stagingBuffer, nullptr);
-	vkFreeMemory(ctx.device, stagingBufferMemory, nullptr);
+	profiler.endFrame();
 }
 
 //
 // Cleanup Vulkan resources
 //
 void cleanupVulkan() {
+	vkDeviceWaitIdle(ctx.device);
+
+	for (VulkanUploadSlot& slot : ctx.uploads) {
+		vkDestroySemaphore(ctx.device, slot.renderFinished, nullptr);
+		vkDestroySemaphore(ctx.device, slot.imageAvailable, nullptr);
+		vkDestroyFence(ctx.device, slot.fence, nullptr);
+		vkUnmapMemory(ctx.device, slot.stagingMemory);
+		vkDestroyBuffer(ctx.device, slot.stagingBuffer, nullptr);
+		vkFreeMemory(ctx.device, slot.stagingMemory, nullptr);
+	}
+
+	destroySwapchain();
+
+	if (ctx.tileDecode) {
+		vkDestroyPipeline(ctx.device, ctx.tilePipeline, nullptr);
+		vkDestroyPipelineLayout(ctx.device, ctx.tilePipelineLayout, nullptr);
+		vkDestroyDescriptorPool(ctx.device, ctx.tileDescriptorPool, nullptr);
+		vkDestroyDescriptorSetLayout(ctx.device, ctx.tileDescriptorSetLayout, nullptr);
+	}
+
+	vkDestroyPipeline(ctx.device, ctx.graphicsPipeline, nullptr);
+	vkDestroyPipelineLayout(ctx.device, ctx.pipelineLayout, nullptr);
+	vkDestroyRenderPass(ctx.device, ctx.renderPass, nullptr);
+	vkDestroyDescriptorPool(ctx.device, ctx.descriptorPool, nullptr);
+	vkDestroyDescriptorSetLayout(ctx.device, ctx.descriptorSetLayout, nullptr);
+	vkDestroyBuffer(ctx.device, ctx.paletteBuffer, nullptr);
+	vkFreeMemory(ctx.device, ctx.paletteBufferMemory, nullptr);
+
 	vkDestroySampler(ctx.device, ctx.textureSampler, nullptr);
 	vkDestroyImageView(ctx.device, ctx.textureImageView, nullptr);
 	vkDestroyImage(ctx.device, ctx.textureImage, nullptr);
 	vkFreeMemory(ctx.device, ctx.textureImageMemory, nullptr);
 	vkDestroyCommandPool(ctx.device, ctx.commandPool, nullptr);
 	vkDestroyDevice(ctx.device, nullptr);
+	vkDestroySurfaceKHR(ctx.instance, ctx.surface, nullptr);
 	vkDestroyInstance(ctx.instance, nullptr);
 }
\ No newline at end of file
@@ -5,6 +5,7 @@
 #include <functional>
 #include <map>
 #include <vector>
+#include <chrono>
 
 #include "../resource.h"
 
@@ -13,6 +14,12 @@
 #include "d2d.h"
 #include "config.h"
 #include "game.h"
+#include "profiler.h"
+
+// Windows 10 1803+; older SDK headers do not define it
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
 
 HWND hwnd = nullptr;
 
@@ -183,53 +190,29 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
 		return HTCLIENT;
 	}
 	case WM_MOUSEMOVE: {
-		POINT cursorPos;
-		GetCursorPos(&cursorPos);
-		ScreenToClient(hwnd, &cursorPos);
-
-		float normalizedX = static_cast<float>(cursorPos.x) / state.ui.width * 100.0f;
-		float normalizedY = static_cast<float>(cursorPos.y) / state.ui.height * 100.0f;
-
-		bool isCursorOver = false;
-
-		// Navigation
-		for (const auto& nav : state.view.navigations) {
-			if (normalizedX >= nav.hotspot.x &&
-				normalizedX <= (nav.hotspot.x + nav.hotspot.width) &&
-				normalizedY >= nav.hotspot.y &&
-				normalizedY <= (nav.hotspot.y + nav.hotspot.height)) {
-
-				SetCursor(handCursor);
-				isCursorOver = true;
-				break;
-			}
-		}
-
-		// Hotspots
-		if (!isCursorOver) {
-			for (const auto& hotspot : state.view.hotspots) {
-				if (normalizedX >= hotspot.x &&
-					normalizedX <= (hotspot.x + hotspot.width) &&
-					normalizedY >= hotspot.y &&
-					normalizedY <= (hotspot.y + hotspot.height)) {
-
-					SetCursor(handCursor);
-					isCursorOver = true;
-					break;
-				}
-			}
-		}
-
-		if (!isCursorOver) {
-			SetCursor(defaultCursor);
-		}
-
+		SetCursor(hitTestCursor() ? handCursor : defaultCursor);
 		return 0;
 	}
 	case WM_LBUTTONDOWN: {
 		handleClick();
 		return 0;
 	}
+	case WM_KEYDOWN: {
+		// devMode: F3 toggles the profiler overlay, F4 writes a Chrome trace
+		if (!profiler.enabled() || (wParam != VK_F3 && wParam != VK_F4))
+			break;
+
+		if (wParam == VK_F3) {
+			profiler.overlay = !profiler.overlay;
+			state.dirty.markAll();	// Redraw what the overlay covered
+			InvalidateRect(hwnd, NULL, FALSE);
+		}
+		else {
+			const std::string traceFile = config.value("traceFile", std::string());
+			profiler.writeTrace(traceFile.empty() ? "trace.json" : traceFile);
+		}
+		return 0;
+	}
 	case WM_DESTROY:
 		::PostQuitMessage(0);
 		return 0;
@@ -383,7 +366,8 @@ void initWindow() {
 	wc.lpszClassName = L"D2DRenderWindowClass";
 	wc.hbrBackground = (HBRUSH)GetStockObject(BLACK_BRUSH);
 
-	if (!RegisterClass(&wc)) {
+	// Already registered when the window is recreated, e.g. by -bench
+	if (!RegisterClass(&wc) && GetLastError() != ERROR_CLASS_ALREADY_EXISTS) {
 		throw std::runtime_error("Failed to register window class");
 	}
 
@@ -415,6 +399,8 @@ void initWindow() {
 // Process events
 //
 bool processEvents() {
+	ScopedTimer timer(ProfileScope::Events);
+
 	MSG msg = {};
 	while (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE)) {
 		if (msg.message == WM_QUIT) {
@@ -426,6 +412,56 @@ bool processEvents() {
 	return true;
 }
 
+/*
+===============================================================================
+Function Name: waitForEvents
+
+Description:
+	- Sleeps until a window message arrives or the deadline passes, so the
+	main loop uses no CPU while a view sits on its last frame.
+
+Parameters:
+	- deadline: When the next frame is due; time_point::max() waits for
+	messages only.
+
+Notes:
+	- The default Windows timer tick (~15.6 ms) is too coarse for 24 fps,
+	so the deadline is a high-resolution waitable timer where available.
+===============================================================================
+*/
+void waitForEvents(std::chrono::steady_clock::time_point deadline) {
+	static HANDLE timer = [] {
+		HANDLE handle = CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+		return handle ? handle : CreateWaitableTimerExW(nullptr, nullptr, 0, TIMER_ALL_ACCESS);
+	}();
+
+	DWORD handleCount = 0;
+
+	if (deadline != std::chrono::steady_clock::time_point::max()) {
+		const auto remaining = deadline - std::chrono::steady_clock::now();
+		if (remaining <= std::chrono::steady_clock::duration::zero()) {
+			return;
+		}
+
+		// Negative due time is relative, in 100 ns units
+		LARGE_INTEGER dueTime;
+		dueTime.QuadPart = -std::max<LONGLONG>(1, std::chrono::duration_cast<std::chrono::nanoseconds>(remaining).count() / 100);
+
+		if (timer && SetWaitableTimer(timer, &dueTime, 0, nullptr, nullptr, FALSE)) {
+			handleCount = 1;
+		}
+		else {
+			// No timer: fall back to a millisecond timeout
+			MsgWaitForMultipleObjectsEx(0, nullptr,
+				static_cast<DWORD>(std::chrono::ceil<std::chrono::milliseconds>(remaining).count()),
+				QS_ALLINPUT, MWMO_INPUTAVAILABLE);
+			return;
+		}
+	}
+
+	MsgWaitForMultipleObjectsEx(handleCount, &timer, INFINITE, QS_ALLINPUT, MWMO_INPUTAVAILABLE);
+}
+
 //
 // Abstractions
 //
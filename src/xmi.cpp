@@ -10,9 +10,61 @@
 #include <windows.h>
 #include <iostream>
 #include <mmsystem.h>
+#include <queue>
+#include <functional>
+#include <stdexcept>
 
 #include "xmi.h"
 #include "rl.h"
+#include "music.h"
+
+/*
+===============================================================================
+Function Name: xmiArchive
+
+Description:
+	- XMI.RL/XMI.GJD, opened and mapped on first use and shared from then
+	on, so converting song after song never reopens the archive.
+
+Return:
+	- const GJDArchive&: The XMI archive. Safe to use from any thread.
+	Without XMI.GJD it has no entries, so every song lookup fails.
+
+Notes:
+	- The music thread is usually the first to get here, so a missing
+	archive is only reported on the console instead of ending the game.
+===============================================================================
+*/
+const GJDArchive& xmiArchive()
+{
+	static const GJDArchive archive = [] {
+		GJDArchive xmi = openGJDArchive("XMI.RL", false);
+		if (xmi.entries.empty())
+			std::cerr << "ERROR: Failed to open " << xmi.gjdFilename << "; music is disabled" << std::endl;
+		return xmi;
+	}();
+	return archive;
+}
+
+//
+// Convert a song from the XMI archive, straight from its mapping when there is one
+//
+std::vector<uint8_t> xmiConverter(const RLEntry& song)
+{
+	const GJDArchive& archive = xmiArchive();
+
+	if (archive.mapping && song.offset + song.length <= archive.mapping->size)
+	{
+		return xmiConverter(archive.mapping->data().subspan(song.offset, song.length));
+	}
+
+	std::ifstream xmiData(archive.gjdFilename, std::ios::binary);
+	std::vector<uint8_t> xmiFile(song.length);
+	xmiData.seekg(song.offset);
+	xmiData.read(reinterpret_cast<char*>(xmiFile.data()), song.length);
+
+	return xmiConverter(xmiFile);
+}
 
 /*
 ===============================================================================
@@ -23,26 +75,34 @@ Description:
 	vector of uint8_t
 
 Parameters:
-	- const std::string_view song: The name of the song to convert
+	- xmiFile: The XMI file data
 
 Return:
 	- std::vector<uint8_t>: Standard MIDI file data as a vector of uint8_t
+
+Notes:
+	- XMI note-ons carry their duration. Pending note-offs wait in a
+	min-heap keyed by absolute time, so each event costs O(log n) in the
+	number of sounding notes and there is no limit on how many there are.
 ===============================================================================
 */
-std::vector<uint8_t> xmiConverter(const RLEntry& song)
+std::vector<uint8_t> xmiConverter(std::span<const uint8_t> xmiFile)
 {
 	struct NOEVENTS
 	{
-		unsigned delta;
+		uint64_t time;						// Absolute XMI tick the note ends on
+		uint64_t order;						// Note-on order, so equal times stay in the order they were played
 		std::array<unsigned char, 3> off;
-	};
 
-	std::array<NOEVENTS, 1000> off_events{ {{0xFFFFFFFFL, { 0, 0, 0 }}} };
-
-	auto comp_events = [](const NOEVENTS& a, const NOEVENTS& b)
+		bool operator>(const NOEVENTS& other) const
 		{
-			return a.delta < b.delta;
-		};
+			return time != other.time ? time > other.time : order > other.order;
+		}
+	};
+
+	std::priority_queue<NOEVENTS, std::vector<NOEVENTS>, std::greater<NOEVENTS>> off_events;
+	uint64_t now = 0;
+	uint64_t notes = 0;
 
 	std::array<unsigned char, 18> midiheader = { 'M', 'T', 'h', 'd', 0, 0, 0, 6, 0, 0, 0, 1, 0, 60, 'M', 'T', 'r', 'k' };
 
@@ -54,18 +114,16 @@ std::vector<uint8_t> xmiConverter(const RLEntry& song)
 	unsigned short timebase = 960;
 	unsigned long qnlen = DEFAULT_QN;
 
-	//
-	// Find the XMI file in XMI.GJD
-	//
-	std::ifstream xmiData("XMI.GJD", std::ios::binary | std::ios::ate);
-	std::vector<uint8_t> xmiFile(song.length);
-	xmiData.seekg(song.offset);
-	xmiData.read(reinterpret_cast<char*>(xmiFile.data()), song.length);
+	if (xmiFile.size() < 4 * 12 + 2 + 4)
+	{
+		throw std::runtime_error("xmiConverter: XMI data is too short");
+	}
 
-	unsigned char* cur = xmiFile.data();
+	const unsigned char* cur = xmiFile.data();
+	const unsigned char* const end = xmiFile.data() + xmiFile.size();
 
 	cur += 4 * 12 + 2;
-	unsigned lTIMB = _byteswap_ulong(*reinterpret_cast<unsigned*>(cur));
+	unsigned lTIMB = _byteswap_ulong(*reinterpret_cast<const unsigned*>(cur));
 	cur += 4;
 
 	for (unsigned i = 0; i < lTIMB; i += 2)
@@ -73,10 +131,10 @@ std::vector<uint8_t> xmiConverter(const RLEntry& song)
 		cur += 2;
 	}
 
-	if (!std::memcmp(cur, "RBRN", 4))
+	if (cur + 10 <= end && !std::memcmp(cur, "RBRN", 4))
 	{
 		cur += 8;
-		unsigned short nBranch = *reinterpret_cast<unsigned short*>(cur);
+		unsigned short nBranch = *reinterpret_cast<const unsigned short*>(cur);
 		cur += 2;
 
 		for (unsigned i = 0; i < nBranch; i++)
@@ -85,78 +143,30 @@ std::vector<uint8_t> xmiConverter(const RLEntry& song)
 		}
 	}
 
+	if (cur + 8 > end)
+	{
+		throw std::runtime_error("xmiConverter: XMI data has no EVNT chunk");
+	}
+
 	cur += 4;
-	unsigned lEVNT = _byteswap_ulong(*reinterpret_cast<unsigned*>(cur));
+	unsigned lEVNT = std::min<unsigned>(_byteswap_ulong(*reinterpret_cast<const unsigned*>(cur)), static_cast<unsigned>(end - cur - 4));
 	cur += 4;
 
-	std::vector<unsigned char> midi_decode(xmiFile.size() * 2);
+	// Every XMI byte becomes at most three MIDI bytes: a 4-byte note-on
+	// expands to 3 bytes plus a 3-byte note-off with a delta of up to 4
+	std::vector<unsigned char> midi_decode(xmiFile.size() * 3 + 16);
 
 	unsigned char* dcur = midi_decode.data();
 
-	int next_is_delta = 1;
-	unsigned char* st = cur;
-	unsigned oevents = 0;
-	while (cur - st < lEVNT)
-	{
-		if (*cur < 0x80)
+	auto writeDelta = [&dcur](uint64_t value)
 		{
-			unsigned delay = 0;
-			while (*cur == 0x7F)
-			{
-				delay += *cur++;
-			}
-			delay += *cur++;
-
-			while (delay > off_events[0].delta)
-			{
-				unsigned no_delta = off_events[0].delta;
-				unsigned tdelay = no_delta & 0x7F;
-
-				while ((no_delta >>= 7))
-				{
-					tdelay <<= 8;
-					tdelay |= (no_delta & 0x7F) | 0x80;
-				}
-
-				while (1)
-				{
-					*dcur++ = tdelay & 0xFF;
-					if (tdelay & 0x80)
-					{
-						tdelay >>= 8;
-					}
-					else
-					{
-						break;
-					}
-				}
-				*dcur++ = off_events[0].off[0] & 0x8F;
-				*dcur++ = off_events[0].off[1];
-				*dcur++ = 0x7F;
-
-				delay -= off_events[0].delta;
-				for (unsigned i = 1; i < oevents; i++)
-				{
-					off_events[i].delta -= off_events[0].delta;
-				}
-				off_events[0].delta = 0xFFFFFFFFL;
-
-				std::sort(off_events.begin(), off_events.begin() + oevents, comp_events);
-
-				oevents--;
-			}
+			unsigned delta = static_cast<unsigned>(value);
+			unsigned tdelay = delta & 0x7F;
 
-			for (unsigned i = 0; i < oevents; i++)
-			{
-				off_events[i].delta -= delay;
-			}
-
-			unsigned tdelay = delay & 0x7F;
-
-			while ((delay >>= 7))
+			while ((delta >>= 7))
 			{
 				tdelay <<= 8;
-				tdelay |= (delay & 0x7F) | 0x80;
+				tdelay |= (delta & 0x7F) | 0x80;
 			}
 
 			while (1)
@@ -171,6 +181,38 @@ std::vector<uint8_t> xmiConverter(const RLEntry& song)
 					break;
 				}
 			}
+		};
+
+	int next_is_delta = 1;
+	const unsigned char* st = cur;
+	while (cur - st < lEVNT)
+	{
+		if (*cur < 0x80)
+		{
+			unsigned delay = 0;
+			while (*cur == 0x7F)
+			{
+				delay += *cur++;
+			}
+			delay += *cur++;
+
+			// Note-offs due before the next event go in between
+			const uint64_t target = now + delay;
+			while (!off_events.empty() && off_events.top().time < target)
+			{
+				const NOEVENTS& event = off_events.top();
+
+				writeDelta(event.time - now);
+				*dcur++ = event.off[0] & 0x8F;
+				*dcur++ = event.off[1];
+				*dcur++ = 0x7F;
+
+				now = event.time;
+				off_events.pop();
+			}
+
+			writeDelta(target - now);
+			now = target;
 			next_is_delta = 0;
 		}
 		else
@@ -188,10 +230,10 @@ std::vector<uint8_t> xmiConverter(const RLEntry& song)
 			{
 				if (*(cur + 1) == 0x2F)
 				{
-					for (unsigned i = 0; i < oevents; i++)
+					for (; !off_events.empty(); off_events.pop())
 					{
-						*dcur++ = off_events[i].off[0] & 0x8F;
-						*dcur++ = off_events[i].off[1];
+						*dcur++ = off_events.top().off[0] & 0x8F;
+						*dcur++ = off_events.top().off[1];
 						*dcur++ = 0x7F;
 						*dcur++ = 0;
 					}
@@ -228,13 +270,7 @@ std::vector<uint8_t> xmiConverter(const RLEntry& song)
 					delta += *cur;
 				}
 
-				off_events[oevents].delta = delta;
-				off_events[oevents].off[0] = *(dcur - 3);
-				off_events[oevents].off[1] = *(dcur - 2);
-
-				oevents++;
-
-				std::sort(std::begin(off_events), std::begin(off_events) + oevents, comp_events);
+				off_events.push({ now + delta, notes++, { *(dcur - 3), *(dcur - 2), 0 } });
 			}
 			// Key pressure
 			else if (0xA0 == (*cur & 0xF0))
@@ -276,7 +312,8 @@ std::vector<uint8_t> xmiConverter(const RLEntry& song)
 		}
 	}
 
-	std::vector<unsigned char> midi_write(xmiFile.size() * 2);
+	// Rescaled deltas take at most 4 bytes, and every event has at least 3
+	std::vector<unsigned char> midi_write((dcur - midi_decode.data()) * 2 + 16);
 
 	unsigned char* tcur = midi_write.data();
 
@@ -439,43 +476,21 @@ std::vector<uint8_t> xmiConverter(const RLEntry& song)
 	unsigned long bs_tlen = _byteswap_ulong(static_cast<unsigned long>(tlen));
 	midiData.insert(midiData.end(), reinterpret_cast<const char*>(&bs_tlen), reinterpret_cast<const char*>(&bs_tlen) + sizeof(unsigned));
 
-	midiData.insert(midiData.end(), midi_write.begin(), midi_write.end());
+	midiData.insert(midiData.end(), midi_write.begin(), midi_write.begin() + tlen);
 
 	return midiData;
 }
 
 
 //
-// MIDI Playback
+// MIDI Playback: plays through the music engine until a key is pressed
 //
 void PlayMIDI(const std::vector<uint8_t>& midiData) {
-	// Create a temporary MIDI file in the user's %TEMP% directory
-	wchar_t tempPath[MAX_PATH];
-	GetTempPathW(MAX_PATH, tempPath);
+	MusicPlayer player;
+	player.play(std::make_shared<const MidiSequence>(parseMidiSequence(midiData)), 0);
 
-	wchar_t tempFile[MAX_PATH];
-	GetTempFileNameW(tempPath, L"MIDI", 0, tempFile);
-
-	std::ofstream file(tempFile, std::ios::binary);
-	file.write(reinterpret_cast<const char*>(midiData.data()), midiData.size());
-	file.close();
-
-	std::wstring tempFilePath = tempFile;
-
-	// Open the MIDI file
-	std::wstring openCommand = L"open \"" + tempFilePath + L"\" type sequencer alias midiFile";
-	mciSendStringW(openCommand.c_str(), NULL, 0, NULL);
-
-	// Play the MIDI file
-	mciSendStringW(L"play midiFile from 0", NULL, 0, NULL);
-
-	// Wait for user input to stop playback
 	std::cout << "Press any key to stop playback..." << std::endl;
 	std::cin.get();
 
-	// Close the MIDI device
-	mciSendStringW(L"close midiFile", NULL, 0, NULL);
-
-	// Delete the temporary file
-	DeleteFileW(tempFilePath.c_str());
+	player.shutdown();
 }
\ No newline at end of file